@@ -0,0 +1,97 @@
+// Receive path allocation check: every corpus response is fed through json_stream_receive(), as
+// the curl write callback does, each endpoint with its own arena. The first round may grow the
+// arenas, after that receiving must not allocate at all, whatever the chunk sizes, whether the
+// length is known up front or not. Exits non-zero if it does.
+#include "bench.h"
+#include <vector>
+
+// Count every allocation, by wrapping glibc's allocator
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+static long allocations = 0;
+extern "C" void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* pointer, size_t size) {
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+// The arena stats line, to check it agrees with the count above
+static char lastStats[CHAR_LEN];
+void statsPublish(const char* messageBuffer) {
+    snprintf(lastStats, sizeof(lastStats), "%s", messageBuffer);
+}
+
+typedef struct {
+    const char* file;
+    const char* const* paths;
+    int pathCount;
+    std::string body;
+    Arena text;
+    JsonStream json;
+} Endpoint;
+
+static void receive(Endpoint* endpoint, size_t chunk, bool lengthKnown) {
+    json_stream_init(&endpoint->json, endpoint->paths, endpoint->pathCount, &endpoint->text);
+    const std::string& body = endpoint->body;
+    for (size_t received = 0; received < body.size(); received += chunk) {
+        size_t size = std::min(chunk, body.size() - received);
+        int64_t expected = received == 0 && lengthKnown ? (int64_t)body.size() : -1;
+        json_stream_receive(&endpoint->json, body.data() + received, size, received, expected);
+    }
+    CHECK(json_stream_finish(&endpoint->json), "%s: not parsed", endpoint->file);
+}
+
+int main() {
+    static const char* const weatherPaths[] = {"current.temperature_2m", "current.time", "current.uv_index", "hourly.uv_index[12]"};
+    static const char* const uvPaths[] = {"data[0].uv"};
+    static const char* const tokenPaths[] = {"access_token", "expires_in", "msg"};
+    static const char* const solarPaths[] = {"success", "msg", "batterySoc", "lastUpdateTime"};
+    static const char* const historyPaths[] = {"success", "msg", "stationDataItems[0].buyValue"};
+    Endpoint endpoints[] = {
+        {"openmeteo_forecast.json", weatherPaths, 4, "", {NULL, 0, 0}, {}},
+        {"weatherbit_current.json", uvPaths, 1, "", {NULL, 0, 0}, {}},
+        {"solarman_token.json", tokenPaths, 3, "", {NULL, 0, 0}, {}},
+        {"solarman_realtime.json", solarPaths, 4, "", {NULL, 0, 0}, {}},
+        {"solarman_history_day.json", historyPaths, 3, "", {NULL, 0, 0}, {}},
+        {"solarman_history_month.json", historyPaths, 3, "", {NULL, 0, 0}, {}},
+    };
+    for (Endpoint& endpoint : endpoints) {
+        endpoint.body = bench_corpus(endpoint.file);
+    }
+
+    // First sight of each response, the arenas grow here
+    long start = allocations;
+    for (Endpoint& endpoint : endpoints) {
+        receive(&endpoint, 1369, false);
+    }
+    printf("first round: %ld allocations\n", allocations - start);
+    arena_report_stats();
+
+    const size_t chunks[] = {1, 7, 512, 1369, 16384};
+    for (size_t chunk : chunks) {
+        for (bool lengthKnown : {false, true}) {
+            start = allocations;
+            for (int round = 0; round < 100; round++) {
+                for (Endpoint& endpoint : endpoints) {
+                    receive(&endpoint, chunk, lengthKnown);
+                }
+            }
+            long made = allocations - start;
+            printf("100 rounds in %zu byte chunks, length %s: %ld allocations\n", chunk, lengthKnown ? "known" : "unknown", made);
+            CHECK(made == 0, "%ld allocations receiving %zu byte chunks with the length %s", made, chunk, lengthKnown ? "known" : "unknown");
+        }
+    }
+
+    arena_report_stats();
+    printf("%s\n", lastStats);
+    CHECK(strstr(lastStats, " 0 allocations") != NULL, "arena stats report allocations: %s", lastStats);
+    return bench_result("alloc_check");
+}
@@ -0,0 +1,61 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Helpers shared by the benchmarks and checks in bench/, see bench/README.md
+#include "globals.h"
+#include <chrono>
+#include <string>
+
+#ifndef BENCH_CORPUS_DIR
+#define BENCH_CORPUS_DIR "bench/corpus"
+#endif
+
+static int benchFailures = 0;
+
+// Record a failed check and carry on, so one run reports every failure
+#define CHECK(condition, ...)                                                                                                                                        \
+    do {                                                                                                                                                             \
+        if (!(condition)) {                                                                                                                                          \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                                                              \
+            printf(__VA_ARGS__);                                                                                                                                     \
+            printf("\n");                                                                                                                                            \
+            benchFailures++;                                                                                                                                         \
+        }                                                                                                                                                            \
+    } while (0)
+
+// Exit status of a check, after printing its summary
+static inline int bench_result(const char* name) {
+    if (benchFailures > 0) {
+        printf("%s: %d checks failed\n", name, benchFailures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+static inline double bench_now_us() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline std::string bench_read_file(const char* path) {
+    std::string contents;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        printf("Cannot read %s\n", path);
+        exit(1);
+    }
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, got);
+    }
+    fclose(file);
+    return contents;
+}
+
+// Corpus file by name, the makefile runs everything from the top of the tree
+static inline std::string bench_corpus(const char* name) {
+    return bench_read_file((std::string(BENCH_CORPUS_DIR "/") + name).c_str());
+}
+
+#endif // BENCH_H
@@ -0,0 +1,65 @@
+// CRC32C (crc32c.cpp) against the one byte XOR checksum it replaced: throughput from a small
+// section up to the readings table, and how many two byte swaps each one misses. Exits non-zero
+// if the CRC does not give the standard check value.
+#include "bench.h"
+#include <vector>
+
+// The checksum saveDataBlock() used before
+static uint8_t xor_checksum(const void* data_ptr, size_t size) {
+    uint8_t sum = 0;
+    const uint8_t* bytePtr = (const uint8_t*)data_ptr;
+    for (size_t i = 0; i < size; ++i) {
+        sum ^= bytePtr[i];
+    }
+    return sum;
+}
+
+int main() {
+    uint32_t check = crc32c("123456789", 9);
+    if (check != 0xE3069283u) {
+        printf("crc32c(\"123456789\") is %08X, expected E3069283\n", check);
+        return 1;
+    }
+
+    std::vector<uint8_t> data(sizeof(ReadingsTable));
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (uint8_t)(i * 31 + 7);
+    }
+    printf("%10s %12s %10s %12s %10s\n", "bytes", "xor ns", "xor MB/s", "crc32c ns", "crc MB/s");
+    for (size_t size : {(size_t)64, sizeof(Solar), (size_t)1024, (size_t)16384, sizeof(ReadingsTable)}) {
+        int iterations = (int)std::max<size_t>(100, 64 * 1024 * 1024 / size);
+        uint32_t sink = 0;
+        double start = bench_now_us();
+        for (int i = 0; i < iterations; i++) {
+            data[0] = (uint8_t)i;
+            sink += xor_checksum(data.data(), size);
+        }
+        double xorTime = (bench_now_us() - start) * 1000 / iterations;
+        start = bench_now_us();
+        for (int i = 0; i < iterations; i++) {
+            data[0] = (uint8_t)i;
+            sink += crc32c(data.data(), size);
+        }
+        double crcTime = (bench_now_us() - start) * 1000 / iterations;
+        printf("%10zu %12.0f %10.0f %12.0f %10.0f%s\n", size, xorTime, size * 1000 / xorTime, crcTime, size * 1000 / crcTime, sink == 1 ? " " : "");
+    }
+
+    // Swap two bytes 7 apart, as a torn or misplaced write might
+    int xorMissed = 0;
+    int crcMissed = 0;
+    int swaps = 0;
+    uint8_t xorBefore = xor_checksum(data.data(), 1024);
+    uint32_t crcBefore = crc32c(data.data(), 1024);
+    for (int i = 0; i < 1000; i++) {
+        if (data[i] == data[i + 7]) {
+            continue;
+        }
+        std::swap(data[i], data[i + 7]);
+        swaps++;
+        xorMissed += xor_checksum(data.data(), 1024) == xorBefore;
+        crcMissed += crc32c(data.data(), 1024) == crcBefore;
+        std::swap(data[i], data[i + 7]);
+    }
+    printf("byte swaps missed: xor %d of %d, crc32c %d of %d\n", xorMissed, swaps, crcMissed, swaps);
+    return 0;
+}
@@ -0,0 +1,126 @@
+// One API poll cycle on the real HTTP client (http.cpp): the weather request and the three
+// Solarman requests are started together on the multi handle, as the scheduler does when they
+// fall due, and the cycle ends when the last one finishes. Prints the latency per cycle and the
+// HTTP stats, and has the server in bench/http report the bytes on the wire. With http1 the
+// requests go out as before HTTP/2 and compression were asked for. The first cycle is a warm up.
+// usage: cycle_bench [cycles] [gapMs] [http1]
+#include "bench.h"
+#include <curl/curl.h>
+#include <signal.h>
+
+typedef struct {
+    const char* host;
+    const char* path;
+    const char* post; // NULL for a GET
+    CURL* curl;
+    char url[256];
+    size_t received;
+} CycleRequest;
+
+static CycleRequest requests[] = {
+    {"api.open-meteo.com", "/v1/forecast?latitude=-33.9&longitude=18.4&current=temperature_2m,uv_index&hourly=uv_index", NULL, NULL, "", 0},
+    {"globalapi.solarmanpv.com", "/station/v1.0/realTime?language=en", "{\"stationId\":\"1\"}", NULL, "", 0},
+    {"globalapi.solarmanpv.com", "/station/v1.0/history?language=en", "{\"stationId\":\"1\",\"timeType\":2,\"startTime\":\"2026-10-17\",\"endTime\":\"2026-10-17\"}", NULL, "", 0},
+    {"globalapi.solarmanpv.com", "/station/v1.0/history?language=en", "{\"stationId\":\"1\",\"timeType\":3,\"startTime\":\"2026-10\",\"endTime\":\"2026-10\"}", NULL, "", 0},
+};
+static int pending = 0;
+static double lastDone = 0;
+
+static size_t cycle_write(void* contents, size_t size, size_t nmemb, void* userp) {
+    (void)contents;
+    ((CycleRequest*)userp)->received += size * nmemb;
+    return size * nmemb;
+}
+
+static void cycle_done(void* owner, CURLcode res, long responseCode) {
+    CycleRequest* request = (CycleRequest*)owner;
+    http_count_decoded(request->received);
+    lastDone = bench_now_us();
+    if (res != CURLE_OK || responseCode != 200) {
+        printf("%s failed: %s, %ld\n", request->url, curl_easy_strerror(res), responseCode);
+    }
+    pending--;
+}
+
+// Have the server print its counts since the last report
+static void server_report(pid_t server) {
+    fflush(stdout);
+    kill(server, SIGUSR2);
+    usleep(300000);
+}
+
+int main(int argc, char** argv) {
+    int cycles = argc > 1 ? atoi(argv[1]) : 10;
+    int gapMs = argc > 2 ? atoi(argv[2]) : 1000;
+    bool http1 = argc > 3 && strcmp(argv[3], "http1") == 0;
+    const char* port = getenv("BENCH_HTTP_PORT");
+    const char* serverPid = getenv("BENCH_HTTP_PID");
+    if (!port || !serverPid) {
+        printf("Run through bench/http/run.sh\n");
+        return 1;
+    }
+    // The real host names, resolved to the local server. CURLOPT_CONNECT_TO would keep the URLs
+    // as they are, but stops curl waiting to multiplex on a connection still being set up
+    struct curl_slist* resolve = NULL;
+    for (CycleRequest& request : requests) {
+        char entry[128];
+        snprintf(entry, sizeof(entry), "%s:%s:127.0.0.1", request.host, port);
+        resolve = curl_slist_append(resolve, entry);
+        snprintf(request.url, sizeof(request.url), "https://%s:%s%s", request.host, port, request.path);
+    }
+    struct curl_slist* headers = curl_slist_append(curl_slist_append(NULL, "Content-Type: application/json"), "Authorization: bearer token");
+
+    http_init();
+    double total = 0;
+    double worst = 0;
+    size_t decoded = 0;
+    for (int cycle = 0; cycle <= cycles; cycle++) {
+        if (cycle == 1) {
+            http_report_stats();
+            server_report(atoi(serverPid));
+            total = 0;
+            worst = 0;
+            decoded = 0;
+        }
+        double start = bench_now_us();
+        for (CycleRequest& request : requests) {
+            request.curl = http_handle(request.curl);
+            request.received = 0;
+            curl_easy_setopt(request.curl, CURLOPT_URL, request.url);
+            curl_easy_setopt(request.curl, CURLOPT_WRITEFUNCTION, cycle_write);
+            curl_easy_setopt(request.curl, CURLOPT_WRITEDATA, &request);
+            if (request.post) {
+                curl_easy_setopt(request.curl, CURLOPT_HTTPHEADER, headers);
+                curl_easy_setopt(request.curl, CURLOPT_POSTFIELDS, request.post);
+            }
+            curl_easy_setopt(request.curl, CURLOPT_RESOLVE, resolve);
+            curl_easy_setopt(request.curl, CURLOPT_SSL_VERIFYPEER, 0L);
+            curl_easy_setopt(request.curl, CURLOPT_SSL_VERIFYHOST, 0L);
+            if (http1) {
+                curl_easy_setopt(request.curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1);
+                curl_easy_setopt(request.curl, CURLOPT_ACCEPT_ENCODING, NULL);
+            }
+            if (http_start(request.curl, &request)) {
+                pending++;
+            }
+        }
+        while (pending > 0) {
+            http_run(1000, cycle_done);
+        }
+        double took = (lastDone - start) / 1000;
+        if (cycle > 0) {
+            total += took;
+            worst = std::max(worst, took);
+            for (const CycleRequest& request : requests) {
+                decoded += request.received;
+            }
+        }
+        usleep(gapMs * 1000);
+    }
+
+    printf("%s, %d cycles: latency per cycle avg %.1f ms max %.1f ms, %.0f body bytes per cycle\n", http1 ? "HTTP/1.1 uncompressed" : "as configured", cycles,
+           total / cycles, worst, decoded / (double)cycles);
+    http_report_stats();
+    server_report(atoi(serverPid));
+    return 0;
+}
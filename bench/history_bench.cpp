@@ -0,0 +1,89 @@
+// Cost per sample of a sensor's trend history: the ring buffer with a running sum in readings.cpp
+// against the shift-and-sum array update_readings() used before. The makefile builds one binary
+// per history depth (STORED_READING). Exits non-zero if the running mean drifts from a full sum.
+#include "bench.h"
+#include <random>
+#include <vector>
+
+// readings.cpp also loads and logs the table, none of which runs here
+std::mutex dataMutex;
+DataWriteGuard::DataWriteGuard() {
+    dataMutex.lock();
+}
+DataWriteGuard::~DataWriteGuard() {
+    dataMutex.unlock();
+}
+bool state_restore(int section) {
+    (void)section;
+    return false;
+}
+void wal_snapshot_written(uint64_t sequence) {
+    (void)sequence;
+}
+
+// The history update_readings() kept before, sums every value and shifts the array once full
+typedef struct {
+    float lastValue[STORED_READING];
+    int readingIndex;
+} ShiftHistory;
+
+static float shift_update(ShiftHistory* history, float value) {
+    float average = 0;
+    if (history->readingIndex > 0) {
+        float total = 0;
+        for (int i = 0; i < history->readingIndex; i++) {
+            total += history->lastValue[i];
+        }
+        average = total / history->readingIndex;
+    }
+    if (history->readingIndex == STORED_READING) {
+        history->readingIndex--;
+        for (int i = 0; i < STORED_READING - 1; i++) {
+            history->lastValue[i] = history->lastValue[i + 1];
+        }
+    }
+    history->lastValue[history->readingIndex++] = value;
+    return average;
+}
+
+int main() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> temperature(-10, 40);
+    static ReadingHistory ring;
+    static ShiftHistory shift;
+
+    // The running mean against a sum over the ring, across several laps
+    for (int n = 0; n < 3 * STORED_READING + 1000; n++) {
+        history_add(&ring, temperature(random));
+        double sum = 0;
+        for (uint32_t i = 0; i < ring.count; i++) {
+            sum += ring.samples[i];
+        }
+        if (fabs(sum / ring.count - history_mean(&ring)) > 1e-3) {
+            printf("depth %d: running mean %f, full sum gives %f after %d samples\n", STORED_READING, history_mean(&ring), sum / ring.count, n + 1);
+            return 1;
+        }
+    }
+
+    const int samples = 2000000 / (1 + STORED_READING / 100);
+    std::vector<float> values(samples);
+    for (float& value : values) {
+        value = temperature(random);
+    }
+    memset(&ring, 0, sizeof(ring));
+    float sink = 0;
+    double start = bench_now_us();
+    for (float value : values) {
+        sink += shift_update(&shift, value);
+    }
+    double shiftTime = bench_now_us() - start;
+    start = bench_now_us();
+    for (float value : values) {
+        sink -= history_mean(&ring);
+        history_add(&ring, value);
+    }
+    double ringTime = bench_now_us() - start;
+    printf("depth %5d: shift and sum %9.1f ns per sample, ring %6.1f ns per sample%s\n", STORED_READING, shiftTime * 1000 / samples, ringTime * 1000 / samples,
+           sink == 0.5f ? " " : "");
+    return 0;
+}
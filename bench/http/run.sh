@@ -0,0 +1,30 @@
+#!/bin/sh
+# Run a harness against the local API server in server.js, which needs node. A throwaway
+# self-signed certificate is made on first use, the harness does not verify it.
+# BENCH_HTTP_PORT is where the delaying proxy listens, the server itself takes the next port.
+# BENCH_HTTP_DELAY_MS is the delay each way and BENCH_HTTP_IDLE_MS the server's idle timeout.
+# usage: run.sh harness [args...]
+set -e
+HERE=$(dirname "$0")
+WORK=${BENCH_HTTP_DIR:-build/bench/http}
+PORT=${BENCH_HTTP_PORT:-8443}
+IDLE_MS=${BENCH_HTTP_IDLE_MS:-60000}
+DELAY_MS=${BENCH_HTTP_DELAY_MS:-20}
+mkdir -p "$WORK"
+if [ ! -f "$WORK/key.pem" ]; then
+    openssl req -x509 -newkey rsa:2048 -nodes -days 30 -subj /CN=localhost -keyout "$WORK/key.pem" -out "$WORK/cert.pem" 2>/dev/null
+fi
+
+rm -f "$WORK/server.pid"
+node "$HERE/server.js" "$PORT" "$IDLE_MS" "$WORK/key.pem" "$WORK/cert.pem" "$WORK/server.pid" "$DELAY_MS" &
+server=$!
+while [ ! -f "$WORK/server.pid" ]; do
+    kill -0 $server 2>/dev/null || exit 1
+    sleep 0.1
+done
+
+status=0
+BENCH_HTTP_PORT=$PORT BENCH_HTTP_PID=$server "$@" || status=$?
+kill $server
+wait
+exit $status
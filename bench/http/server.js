@@ -0,0 +1,72 @@
+// Local stand-in for the APIs the program polls: HTTPS with HTTP/2 and HTTP/1.1 on one port,
+// each request answered with its corpus response, gzip or brotli compressed if the client asks.
+// A TCP proxy in front adds a delay each way to stand in for the network and counts the bytes
+// on the wire. SIGUSR2 prints the counts since the last report and resets them, SIGTERM prints
+// them and stops.
+// usage: node server.js port idleTimeoutMs keyFile certFile pidFile [oneWayDelayMs]
+const http2 = require('http2'), fs = require('fs'), path = require('path'), zlib = require('zlib'), net = require('net');
+const [port, idle] = process.argv.slice(2, 4).map(Number);
+const [keyFile, certFile, pidFile] = process.argv.slice(4, 7);
+const delay = Number(process.argv[7] || 0);
+const corpus = path.join(__dirname, '..', 'corpus');
+
+// Matched against the path and request body, the two history calls differ only in the body
+const routes = [['/v1/forecast', 'openmeteo_forecast.json'], ['/v2.0/current', 'weatherbit_current.json'], ['/account/v1.0/token', 'solarman_token.json'],
+                ['/station/v1.0/realTime', 'solarman_realtime.json'], ['"timeType":2', 'solarman_history_day.json'], ['"timeType":3', 'solarman_history_month.json']];
+const bodies = {};
+for (const [, file] of routes) bodies[file] = fs.readFileSync(path.join(corpus, file));
+
+let wire = 0, requests = 0, connections = 0, http2Requests = 0;
+const server = http2.createSecureServer({key: fs.readFileSync(keyFile), cert: fs.readFileSync(certFile), allowHTTP1: true}, (req, res) => {
+    let data = '';
+    req.on('data', chunk => data += chunk);
+    req.on('end', () => {
+        const key = req.url + data;
+        let body = Buffer.from('{}');
+        for (const [match, file] of routes) if (key.includes(match)) body = bodies[file];
+        const headers = {'content-type': 'application/json'};
+        const accept = req.headers['accept-encoding'] || '';
+        if (/\bbr\b/.test(accept)) {
+            body = zlib.brotliCompressSync(body, {params: {[zlib.constants.BROTLI_PARAM_QUALITY]: 5}});
+            headers['content-encoding'] = 'br';
+        } else if (/\bgzip\b/.test(accept)) {
+            body = zlib.gzipSync(body);
+            headers['content-encoding'] = 'gzip';
+        }
+        headers['content-length'] = body.length;
+        requests++;
+        if (req.httpVersion === '2.0') http2Requests++;
+        res.writeHead(200, headers);
+        res.end(body);
+    });
+});
+// Idle connections are closed, as the real API servers do
+server.setTimeout(idle);
+server.on('secureConnection', () => connections++);
+server.listen(port + 1, '127.0.0.1');
+
+// The delaying proxy clients connect to, counting the encrypted bytes both ways
+net.createServer(client => {
+    const upstream = net.connect(port + 1, '127.0.0.1');
+    const pipe = (from, to) => from.on('data', chunk => {
+        wire += chunk.length;
+        setTimeout(() => to.write(chunk), delay);
+    });
+    pipe(client, upstream);
+    pipe(upstream, client);
+    const close = () => setTimeout(() => { client.destroy(); upstream.destroy(); }, delay);
+    client.on('close', close);
+    upstream.on('close', close);
+    client.on('error', () => {});
+    upstream.on('error', () => {});
+}).listen(port, '127.0.0.1', () => fs.writeFileSync(pidFile, String(process.pid)));
+
+const report = () => {
+    console.log(`server: ${requests} requests, ${http2Requests} over HTTP/2, ${connections} TLS connections, ${wire} bytes on the wire`);
+    wire = requests = connections = http2Requests = 0;
+};
+process.on('SIGUSR2', report);
+process.on('SIGTERM', () => {
+    report();
+    process.exit(0);
+});
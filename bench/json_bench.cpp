@@ -0,0 +1,119 @@
+// Time and allocations per response of the streaming extractor against json-c, the parser the
+// pollers used before, on the corpus responses. json-c is only needed here (libjson-c-dev).
+#include "bench.h"
+#include <json-c/json.h>
+#include <vector>
+
+// Count every allocation, by wrapping glibc's allocator
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+static long allocations = 0;
+extern "C" void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* pointer, size_t size) {
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+// A "a.b[0].c" path looked up in a json-c tree, as the pollers did by hand
+static bool json_c_number(json_object* object, const char* path, double* number) {
+    char key[128];
+    const char* p = path;
+    while (*p) {
+        size_t length = strcspn(p, ".[");
+        memcpy(key, p, length);
+        key[length] = '\0';
+        p += length;
+        if (length > 0 && !json_object_object_get_ex(object, key, &object)) {
+            return false;
+        }
+        while (*p == '[') {
+            object = json_object_array_get_idx(object, atoi(p + 1));
+            if (!object) {
+                return false;
+            }
+            p = strchr(p, ']') + 1;
+        }
+        if (*p == '.') {
+            p++;
+        }
+    }
+    *number = json_object_is_type(object, json_type_string) ? strtod(json_object_get_string(object), NULL) : json_object_get_double(object);
+    return true;
+}
+
+typedef struct {
+    const char* file;
+    std::vector<const char*> paths;
+} BenchCase;
+
+int main() {
+    // The fields each endpoint asks for
+    BenchCase cases[] = {
+        {"openmeteo_forecast.json",
+         {"current.temperature_2m", "current.wind_direction_10m", "current.wind_speed_10m", "current.is_day", "current.weather_code", "daily.temperature_2m_max[0]",
+          "daily.temperature_2m_min[0]", "current.time", "current.uv_index", "hourly.uv_index[12]"}},
+        {"weatherbit_current.json", {"data[0].uv"}},
+        {"solarman_token.json", {"access_token", "expires_in", "msg"}},
+        {"solarman_realtime.json", {"success", "msg", "batterySoc", "usePower", "wirePower", "batteryPower", "lastUpdateTime", "generationPower"}},
+        {"solarman_history_day.json", {"success", "msg", "stationDataItems[0].buyValue"}},
+        {"solarman_history_month.json", {"success", "msg", "stationDataItems[0].buyValue"}},
+    };
+    const int iterations = 20000;
+    static JsonStream stream;
+    Arena text = {NULL, 0, 0};
+
+    printf("%-28s %6s  %10s %8s  %10s %8s\n", "response", "bytes", "json-c us", "allocs", "stream us", "allocs");
+    for (const BenchCase& c : cases) {
+        std::string doc = bench_corpus(c.file);
+        double sink = 0;
+        double value;
+
+        long startAllocations = allocations;
+        double start = bench_now_us();
+        for (int i = 0; i < iterations; i++) {
+            json_object* root = json_tokener_parse(doc.c_str());
+            for (const char* path : c.paths) {
+                if (json_c_number(root, path, &value)) {
+                    sink += value;
+                }
+            }
+            json_object_put(root);
+        }
+        double jsonCTime = bench_now_us() - start;
+        long jsonCAllocations = allocations - startAllocations;
+
+        arena_reserve(&text, doc.size() + 1);
+        startAllocations = allocations;
+        start = bench_now_us();
+        for (int i = 0; i < iterations; i++) {
+            json_stream_init(&stream, c.paths.data(), c.paths.size(), &text);
+            // Fed as TLS records of up to 1369 bytes, as curl hands them over
+            for (size_t offset = 0; offset < doc.size(); offset += 1369) {
+                json_stream_feed(&stream, doc.data() + offset, std::min<size_t>(1369, doc.size() - offset));
+            }
+            if (!json_stream_finish(&stream)) {
+                printf("%s: parse failed\n", c.file);
+                return 1;
+            }
+            for (const char* path : c.paths) {
+                if (json_stream_number(&stream, path, &value)) {
+                    sink += value;
+                }
+            }
+        }
+        double streamTime = bench_now_us() - start;
+        long streamAllocations = allocations - startAllocations;
+
+        printf("%-28s %6zu  %10.2f %8.1f  %10.2f %8.1f%s\n", c.file, doc.size(), jsonCTime / iterations, jsonCAllocations / (double)iterations,
+               streamTime / iterations, streamAllocations / (double)iterations, sink == 0.5 ? " " : "");
+    }
+    return 0;
+}
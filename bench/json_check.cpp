@@ -0,0 +1,201 @@
+// Checks of the streaming JSON extractor (jsonstream.cpp): the fields of every corpus response,
+// the same fields with the body cut at every possible point, escapes, nulls, quoted numbers and
+// malformed documents. Exits non-zero if any check fails.
+#include "bench.h"
+#include <vector>
+
+typedef struct {
+    bool wellFormed;
+    bool found[JSON_MAX_FIELDS];
+    double number[JSON_MAX_FIELDS];
+    std::string text[JSON_MAX_FIELDS]; // "<none>" if the value was not a string
+} ParseResult;
+
+static Arena text = {NULL, 0, 0};
+static JsonStream stream;
+
+// Parse doc with its bytes handed over in the chunk sizes given, the last size repeating
+static ParseResult parse(const std::string& doc, const char* const* paths, int count, const std::vector<size_t>& chunks) {
+    arena_reserve(&text, doc.size() + 1);
+    json_stream_init(&stream, paths, count, &text);
+    size_t offset = 0;
+    for (size_t n = 0; offset < doc.size(); n++) {
+        size_t size = chunks[n < chunks.size() ? n : chunks.size() - 1];
+        size = std::min(size, doc.size() - offset);
+        json_stream_feed(&stream, doc.data() + offset, size);
+        offset += size;
+    }
+
+    ParseResult result;
+    result.wellFormed = json_stream_finish(&stream);
+    for (int i = 0; i < count; i++) {
+        result.found[i] = json_stream_number(&stream, paths[i], &result.number[i]);
+        const char* value = json_stream_string(&stream, paths[i]);
+        result.text[i] = value ? value : "<none>";
+    }
+    return result;
+}
+
+static ParseResult parse_whole(const std::string& doc, const char* const* paths, int count) {
+    return parse(doc, paths, count, {doc.size() ? doc.size() : 1});
+}
+
+static bool same_result(const ParseResult& a, const ParseResult& b, int count) {
+    if (a.wellFormed != b.wellFormed) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (a.found[i] != b.found[i] || (a.found[i] && a.number[i] != b.number[i]) || a.text[i] != b.text[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Cut the body in two at every offset, and feed it a byte at a time, the result must not change
+static void check_splits(const char* name, const std::string& doc, const char* const* paths, int count) {
+    ParseResult whole = parse_whole(doc, paths, count);
+    for (size_t split = 1; split < doc.size(); split++) {
+        ParseResult cut = parse(doc, paths, count, {split, doc.size()});
+        CHECK(same_result(whole, cut, count), "%s: different result when split at byte %zu", name, split);
+    }
+    CHECK(same_result(whole, parse(doc, paths, count, {1}), count), "%s: different result fed a byte at a time", name);
+    CHECK(same_result(whole, parse(doc, paths, count, {1369}), count), "%s: different result fed as 1369 byte TLS records", name);
+}
+
+static void check_number(const char* name, const ParseResult& result, int field, double expected) {
+    CHECK(result.found[field] && fabs(result.number[field] - expected) < 1e-9, "%s: field %d is %s%g, expected %g", name, field,
+          result.found[field] ? "" : "missing, ", result.number[field], expected);
+}
+
+static void check_missing(const char* name, const ParseResult& result, int field) {
+    CHECK(!result.found[field], "%s: field %d should be missing, got %g", name, field, result.number[field]);
+}
+
+static void check_text(const char* name, const ParseResult& result, int field, const char* expected) {
+    CHECK(result.text[field] == expected, "%s: field %d is \"%s\", expected \"%s\"", name, field, result.text[field].c_str(), expected);
+}
+
+static void check_corpus() {
+    static const char* const weatherPaths[] = {"current.temperature_2m", "current.wind_direction_10m", "current.is_day", "daily.temperature_2m_max[0]",
+                                               "current.time", "current.uv_index", "hourly.uv_index[13]", "hourly.uv_index[0]"};
+    std::string doc = bench_corpus("openmeteo_forecast.json");
+    ParseResult result = parse_whole(doc, weatherPaths, 8);
+    CHECK(result.wellFormed, "openmeteo_forecast.json: not well formed");
+    check_number("openmeteo", result, 0, 21.4);
+    check_number("openmeteo", result, 1, 162);
+    check_number("openmeteo", result, 2, 1);
+    check_number("openmeteo", result, 3, 23.1);
+    check_text("openmeteo", result, 4, "2026-10-17T14:00");
+    check_number("openmeteo", result, 5, 6.85);
+    check_number("openmeteo", result, 6, 8.35);
+    check_number("openmeteo", result, 7, 0);
+    check_splits("openmeteo_forecast.json", doc, weatherPaths, 8);
+
+    static const char* const uvPaths[] = {"data[0].uv", "data[0].city_name", "data[0].sources[1]", "data[0].weather.code"};
+    doc = bench_corpus("weatherbit_current.json");
+    result = parse_whole(doc, uvPaths, 4);
+    CHECK(result.wellFormed, "weatherbit_current.json: not well formed");
+    check_number("weatherbit", result, 0, 7.2);
+    check_text("weatherbit", result, 1, "Cape Town");
+    check_text("weatherbit", result, 2, "FACT");
+    check_number("weatherbit", result, 3, 802);
+    check_splits("weatherbit_current.json", doc, uvPaths, 4);
+
+    static const char* const tokenPaths[] = {"access_token", "expires_in", "msg"};
+    doc = bench_corpus("solarman_token.json");
+    result = parse_whole(doc, tokenPaths, 3);
+    CHECK(result.wellFormed, "solarman_token.json: not well formed");
+    CHECK(result.text[0].size() == 1280, "solarman_token.json: token is %zu characters, expected 1280", result.text[0].size());
+    check_number("solarman token", result, 1, 5183999);
+    check_missing("solarman token", result, 2);
+    check_splits("solarman_token.json", doc, tokenPaths, 3);
+
+    static const char* const solarPaths[] = {"success", "msg", "batterySoc", "wirePower", "batteryPower", "lastUpdateTime", "gridPower"};
+    doc = bench_corpus("solarman_realtime.json");
+    result = parse_whole(doc, solarPaths, 7);
+    CHECK(result.wellFormed, "solarman_realtime.json: not well formed");
+    check_number("solarman realtime", result, 0, 1);
+    check_missing("solarman realtime", result, 1);
+    check_number("solarman realtime", result, 2, 87);
+    check_number("solarman realtime", result, 3, -12);
+    check_number("solarman realtime", result, 4, -663);
+    check_number("solarman realtime", result, 5, 1760702400);
+    check_missing("solarman realtime", result, 6);
+    check_splits("solarman_realtime.json", doc, solarPaths, 7);
+
+    static const char* const historyPaths[] = {"success", "msg", "stationDataItems[0].buyValue", "stationDataItems[0].day"};
+    doc = bench_corpus("solarman_history_day.json");
+    result = parse_whole(doc, historyPaths, 4);
+    check_number("solarman day", result, 2, 2.1);
+    check_number("solarman day", result, 3, 17);
+    check_splits("solarman_history_day.json", doc, historyPaths, 4);
+    doc = bench_corpus("solarman_history_month.json");
+    result = parse_whole(doc, historyPaths, 4);
+    check_number("solarman month", result, 2, 48.6);
+    check_missing("solarman month", result, 3);
+    check_splits("solarman_history_month.json", doc, historyPaths, 4);
+}
+
+static void check_escapes() {
+    static const char* const paths[] = {"quote", "unicode", "controls", "k\"ey", "after"};
+    std::string doc = "{\"quote\":\"a\\\"b\\\\c\\/d\",\"unicode\":\"\\u0041\\u00e9\\u20AC\",\"controls\":\"1\\n2\\t3\\r\\b\\f\","
+                      "\"k\\\"ey\":5,\"after\":\"}]\\\\\"}";
+    ParseResult result = parse_whole(doc, paths, 5);
+    CHECK(result.wellFormed, "escapes: not well formed");
+    check_text("escapes", result, 0, "a\"b\\c/d");
+    check_text("escapes", result, 1, "A\xC3\xA9\xE2\x82\xAC");
+    check_text("escapes", result, 2, "1\n2\t3\r\b\f");
+    check_number("escapes", result, 3, 5);
+    check_text("escapes", result, 4, "}]\\");
+    check_splits("escapes", doc, paths, 5);
+
+    static const char* const badPaths[] = {"a"};
+    CHECK(!parse_whole("{\"a\":\"\\u12G4\"}", badPaths, 1).wellFormed, "escapes: bad \\u digit accepted");
+}
+
+static void check_nulls() {
+    static const char* const paths[] = {"a", "b[0]", "b[1]", "c.d", "e"};
+    std::string doc = "{\"a\":null,\"b\":[null,2.5],\"c\":{\"d\":null},\"e\":true}";
+    ParseResult result = parse_whole(doc, paths, 5);
+    CHECK(result.wellFormed, "nulls: not well formed");
+    check_missing("nulls", result, 0);
+    check_missing("nulls", result, 1);
+    check_number("nulls", result, 2, 2.5);
+    check_missing("nulls", result, 3);
+    check_number("nulls", result, 4, 1);
+    check_splits("nulls", doc, paths, 5);
+}
+
+static void check_numbers() {
+    static const char* const paths[] = {"quoted", "negative", "exponent", "false", "nested[1][0]", "first"};
+    std::string doc = "{\"quoted\":\"12.5\",\"negative\":-0.25,\"exponent\":1.5e3,\"false\":false,\"nested\":[[1,2],[3,4]],\"first\":1,\"first\":2}";
+    ParseResult result = parse_whole(doc, paths, 6);
+    CHECK(result.wellFormed, "numbers: not well formed");
+    check_number("numbers", result, 0, 12.5);
+    check_text("numbers", result, 0, "12.5");
+    check_number("numbers", result, 1, -0.25);
+    check_number("numbers", result, 2, 1500);
+    check_number("numbers", result, 3, 0);
+    check_number("numbers", result, 4, 3);
+    check_number("numbers", result, 5, 1);
+    check_splits("numbers", doc, paths, 6);
+}
+
+static void check_malformed() {
+    static const char* const paths[] = {"a"};
+    const char* documents[] = {"{\"a\":1", "{\"a\":1,}", "{\"a\" 1}", "[1,2}", "{\"a\":1}x", "{a:1}", ""};
+    for (const char* doc : documents) {
+        CHECK(!parse_whole(doc, paths, 1).wellFormed, "malformed: \"%s\" accepted", doc);
+    }
+    CHECK(parse_whole(" {\"a\" : [ ] }\n", paths, 1).wellFormed, "whitespace: rejected");
+}
+
+int main() {
+    check_corpus();
+    check_escapes();
+    check_nulls();
+    check_numbers();
+    check_malformed();
+    return bench_result("json_check");
+}
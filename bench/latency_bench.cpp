@@ -0,0 +1,77 @@
+// Update to screen latency of the real UI loop (main.cpp): a producer thread calls wakeDisplay()
+// at random gaps of 10 to 400 ms, as MQTT and the pollers do after publishing, while loop() runs
+// on the main thread. Built as latency_bench_0, woken by the producers, and latency_bench_205,
+// the old fixed cadence of the 200 ms sleep in loop() plus the 5 ms one in main(). LVGL is
+// stubbed out in lvgl_stubs.c, so drawing is free and what is measured is the wait for the UI
+// thread.
+// usage: latency_bench_N [updates]
+#include "bench.h"
+#include <random>
+#include <thread>
+
+void loop();
+extern volatile bool running;
+
+// The modules loop() reads from, not linked in
+ReadingsTable readings;
+int numberOfReadings = 0;
+int api_status(int source, bool fresh) {
+    (void)source;
+    return fresh ? STATUS_OK : STATUS_DOWN;
+}
+void copy_reading(ReadingsTable* dest, const ReadingsTable* src, int index) {
+    (void)dest;
+    (void)src;
+    (void)index;
+}
+void set_theme(bool isDay) {
+    (void)isDay;
+}
+void set_solar_values(const Solar* solar) {
+    (void)solar;
+}
+void set_weather_values(const Weather* weather) {
+    (void)weather;
+}
+void set_uv_values(const UV* uv, bool isDay) {
+    (void)uv;
+    (void)isDay;
+}
+void set_status_indicator(lv_obj_t* indicator, int state, int* shownState) {
+    (void)indicator;
+    *shownState = state;
+}
+void mqtt_report_stats() {
+}
+void persistence_report_stats() {
+}
+void wal_report_stats() {
+}
+void ts_report_stats() {
+}
+void http_report_stats() {
+}
+void arena_report_stats() {
+}
+
+int main(int argc, char* argv[]) {
+    int updates = argc > 1 ? atoi(argv[1]) : 100;
+    printf("%d updates, UI_FIXED_CADENCE_MS %d\n", updates, UI_FIXED_CADENCE_MS);
+
+    std::thread producer([updates] {
+        std::mt19937 random(42);
+        std::uniform_int_distribution<int> gapMs(10, 400);
+        for (int i = 0; i < updates; i++) {
+            usleep(gapMs(random) * 1000);
+            wakeDisplay();
+        }
+        usleep(500 * 1000);
+        running = false;
+    });
+    while (running) {
+        loop();
+    }
+    producer.join();
+    reportStats();
+    return 0;
+}
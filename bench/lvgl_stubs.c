@@ -0,0 +1,62 @@
+/* Stand-ins for the LVGL calls and screen objects main.cpp uses, so loop() can run without a
+   display. Kept in C without the LVGL headers, only the symbol names have to match. Drawing is
+   free here, the latency measured is the wait for the UI thread to get round to the update. */
+#include <stdint.h>
+
+typedef struct {
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+} lv_color_t;
+
+void *ui_AsofTimeLabel, *ui_BatteryArc, *ui_BatteryLabel, *ui_BatteryLabel1, *ui_BatteryLabel2;
+void *ui_BatteryLabel3, *ui_BatteryLabel4, *ui_BatteryLabel5, *ui_ChargingLabel, *ui_ChargingTime;
+void *ui_Direction1, *ui_Direction2, *ui_Direction3, *ui_Direction4, *ui_Direction5;
+void *ui_FCConditions, *ui_FCMax, *ui_FCMin, *ui_FCUpdateTime, *ui_FCWindSpeed, *ui_GridBought;
+void *ui_HumidLabel1, *ui_HumidLabel2, *ui_HumidLabel3, *ui_HumidLabel4, *ui_HumidLabel5;
+void *ui_RoomName1, *ui_RoomName2, *ui_RoomName3, *ui_RoomName4, *ui_RoomName5, *ui_ServerStatus;
+void *ui_SolarArc, *ui_SolarLabel, *ui_SolarMinMax, *ui_SolarStatus, *ui_StatusMessage;
+void *ui_TempArc1, *ui_TempArc2, *ui_TempArc3, *ui_TempArc4, *ui_TempArc5, *ui_TempArcFC;
+void *ui_TempLabel1, *ui_TempLabel2, *ui_TempLabel3, *ui_TempLabel4, *ui_TempLabel5;
+void *ui_TempLabelFC, *ui_Time, *ui_UVArc, *ui_UVLabel, *ui_UVUpdateTime, *ui_UsingArc;
+void *ui_UsingLabel, *ui_Version, *ui_WeatherStatus, *ui_WiFiStatus;
+
+/* LVGL asks to be called again after its default refresh period when nothing is animating */
+uint32_t lv_timer_handler(void) {
+    return 33;
+}
+
+void lv_refr_now(void *display) {
+    (void)display;
+}
+
+lv_color_t lv_color_hex(uint32_t hex) {
+    lv_color_t color = {(uint8_t)hex, (uint8_t)(hex >> 8), (uint8_t)(hex >> 16)};
+    return color;
+}
+
+void lv_label_set_text(void *object, const char *text) {
+    (void)object;
+    (void)text;
+}
+
+void lv_arc_set_value(void *object, int32_t value) {
+    (void)object;
+    (void)value;
+}
+
+void lv_obj_add_flag(void *object, uint32_t flag) {
+    (void)object;
+    (void)flag;
+}
+
+void lv_obj_clear_flag(void *object, uint32_t flag) {
+    (void)object;
+    (void)flag;
+}
+
+void lv_obj_set_style_text_color(void *object, lv_color_t color, uint32_t selector) {
+    (void)object;
+    (void)color;
+    (void)selector;
+}
@@ -0,0 +1,91 @@
+// Cost of the rollup lookups (rollups.cpp) against working the same figures out by scanning the
+// history file, on three days of minute samples of one series: today's min/max, the last 24
+// hours, and recording a sample into both.
+#include "bench.h"
+
+static char dataDirectory[] = "/tmp/rollup_bench.XXXXXX";
+
+void getDataFilePath(const char* filename, char* fullpath, size_t fullpath_size) {
+    snprintf(fullpath, fullpath_size, "%s/%s", dataDirectory, filename);
+}
+
+static bool scan_stats(time_t time, float value, void* context) {
+    (void)time;
+    RollupStats* stats = (RollupStats*)context;
+    if (stats->count == 0 || value < stats->min) {
+        stats->min = value;
+    }
+    if (stats->count == 0 || value > stats->max) {
+        stats->max = value;
+    }
+    stats->mean += value;
+    stats->count++;
+    return true;
+}
+
+int main() {
+    if (!mkdtemp(dataDirectory) || !ts_open()) {
+        printf("Cannot create the history file under /tmp\n");
+        return 1;
+    }
+    const int series = TS_SERIES_SOLAR_CHARGE;
+    time_t now = time(NULL);
+    time_t start = now - 3 * 86400;
+    double begin = bench_now_us();
+    for (time_t t = start; t <= now; t += 60) {
+        record_sample(series, t, roundf(500 + 400 * sinf(t * 6.2832f / 86400)) / 10);
+    }
+    int recorded = (int)((now - start) / 60 + 1);
+    double recordTime = (bench_now_us() - begin) * 1000 / recorded;
+
+    struct tm local;
+    localtime_r(&now, &local);
+    local.tm_hour = 0;
+    local.tm_min = 0;
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    time_t midnight = mktime(&local);
+
+    const int lookups = 100000;
+    RollupStats stats;
+    float sink = 0;
+    begin = bench_now_us();
+    for (int i = 0; i < lookups; i++) {
+        rollup_get(series, ROLLUP_DAY, now, &stats);
+        sink += stats.min;
+    }
+    double todayTime = (bench_now_us() - begin) * 1000 / lookups;
+    begin = bench_now_us();
+    for (int i = 0; i < lookups; i++) {
+        rollup_range(series, ROLLUP_HOUR, now - 86400, now, &stats);
+        sink += stats.max;
+    }
+    double rangeTime = (bench_now_us() - begin) * 1000 / lookups;
+
+    const int scans = 200;
+    begin = bench_now_us();
+    for (int i = 0; i < scans; i++) {
+        RollupStats scanned = {0, 0, 0, 0};
+        ts_scan(series, midnight, now, scan_stats, &scanned);
+        sink += scanned.min;
+    }
+    double todayScanTime = (bench_now_us() - begin) * 1000 / scans;
+    begin = bench_now_us();
+    for (int i = 0; i < scans; i++) {
+        RollupStats scanned = {0, 0, 0, 0};
+        ts_scan(series, now - 86400, now, scan_stats, &scanned);
+        sink += scanned.max;
+    }
+    double rangeScanTime = (bench_now_us() - begin) * 1000 / scans;
+
+    printf("%-22s %12s %12s\n", "", "rollup ns", "scan ns");
+    printf("%-22s %12.1f %12.1f\n", "today min/max", todayTime, todayScanTime);
+    printf("%-22s %12.1f %12.1f\n", "last 24 hours", rangeTime, rangeScanTime);
+    printf("record one sample %.1f ns, history file and rollups%s\n", recordTime, sink == 0.5f ? " " : "");
+
+    char filepath[512];
+    getDataFilePath(TS_FILENAME, filepath, sizeof(filepath));
+    unlink(filepath);
+    rmdir(dataDirectory);
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Checks of the rollups (rollups.cpp) against sums worked out directly from the samples with
+// localtime_r: every minute, hour and day bucket still held, ranges, and the hours of a day adding
+// up to the day. Run in zones with half hour offsets and across DST changes. Exits non-zero if any
+// check fails.
+#include "bench.h"
+#include <map>
+#include <sys/wait.h>
+#include <vector>
+
+// No history file, the rollups are fed directly
+void ts_append(int series, time_t time, float value) {
+    (void)series;
+    (void)time;
+    (void)value;
+}
+
+int ts_scan(int series, time_t from, time_t to, bool (*visit)(time_t time, float value, void* context), void* context) {
+    (void)series;
+    (void)from;
+    (void)to;
+    (void)visit;
+    (void)context;
+    return 0;
+}
+
+typedef struct {
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+} Expected;
+
+typedef struct {
+    time_t time;
+    float value;
+} Sample;
+
+// Local start of the minute, hour or day holding time, worked out without the code under test
+static time_t local_start(int resolution, time_t time) {
+    struct tm local;
+    localtime_r(&time, &local);
+    switch (resolution) {
+    case ROLLUP_MINUTE:
+        return time - local.tm_sec;
+    case ROLLUP_HOUR:
+        return time - local.tm_min * 60 - local.tm_sec;
+    default:
+        local.tm_hour = 0;
+        local.tm_min = 0;
+        local.tm_sec = 0;
+        local.tm_isdst = -1;
+        return mktime(&local);
+    }
+}
+
+static void expect_add(Expected* expected, float value) {
+    if (expected->count == 0 || value < expected->min) {
+        expected->min = value;
+    }
+    if (expected->count == 0 || value > expected->max) {
+        expected->max = value;
+    }
+    expected->sum += value;
+    expected->count++;
+}
+
+static bool same_stats(const RollupStats& got, const Expected& expected) {
+    return got.count == expected.count && got.min == expected.min && got.max == expected.max && fabs(got.mean - expected.sum / expected.count) < 1e-3;
+}
+
+static const char* const resolutionNames[ROLLUP_RESOLUTIONS] = {"minute", "hour", "day"};
+static const int bucketCounts[ROLLUP_RESOLUTIONS] = {ROLLUP_MINUTE_BUCKETS, ROLLUP_HOUR_BUCKETS, ROLLUP_DAY_BUCKETS};
+
+// Samples every 47 seconds for 40 days up to end, then every bucket the rings still hold
+static void check_zone(const char* zone, time_t end) {
+    setenv("TZ", zone, 1);
+    tzset();
+    const int series = TS_SERIES_READING(3);
+    std::vector<Sample> samples;
+    for (time_t time = end - 40 * 86400; time <= end; time += 47) {
+        samples.push_back({time, roundf(200 * sinf(time / 5000.0f)) / 10});
+        rollup_add(series, time, samples.back().value);
+    }
+
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++) {
+        std::map<time_t, Expected> periods;
+        for (const Sample& sample : samples) {
+            expect_add(&periods[local_start(resolution, sample.time)], sample.value);
+        }
+        // Only the newest buckets of each ring are kept
+        int checked = 0;
+        for (auto period = periods.rbegin(); period != periods.rend() && checked < bucketCounts[resolution]; ++period, checked++) {
+            RollupStats got;
+            bool found = rollup_get(series, resolution, period->first, &got);
+            CHECK(found && same_stats(got, period->second), "%s: %s starting %lld: %s count %u min %g max %g, expected count %u min %g max %g", zone,
+                  resolutionNames[resolution], (long long)period->first, found ? "got" : "missing,", found ? got.count : 0, found ? got.min : 0, found ? got.max : 0,
+                  period->second.count, period->second.min, period->second.max);
+        }
+    }
+
+    // The last 24 hours, and the hours of yesterday against yesterday itself
+    Expected day = {0, 0, 0, 0};
+    time_t from = local_start(ROLLUP_HOUR, end - 86400);
+    for (const Sample& sample : samples) {
+        if (sample.time >= from) {
+            expect_add(&day, sample.value);
+        }
+    }
+    RollupStats got;
+    CHECK(rollup_range(series, ROLLUP_HOUR, end - 86400, end, &got) && same_stats(got, day), "%s: 24 hour range differs", zone);
+
+    time_t today = local_start(ROLLUP_DAY, end);
+    time_t yesterday = local_start(ROLLUP_DAY, today - 1);
+    RollupStats hours;
+    RollupStats whole;
+    CHECK(rollup_range(series, ROLLUP_HOUR, yesterday, today - 1, &hours) && rollup_get(series, ROLLUP_DAY, yesterday, &whole) && hours.count == whole.count &&
+              hours.min == whole.min && hours.max == whole.max,
+          "%s: yesterday's hours hold %u samples, the day %u", zone, hours.count, whole.count);
+}
+
+// Each zone in its own process, the rollups cache the current local hour and day
+int main() {
+    // 2026-10-25 01:00 UTC, Berlin moves back an hour, Adelaide moved forward on 4 October
+    const time_t fallBack = 1792890000;
+    struct {
+        const char* zone;
+        time_t end;
+    } cases[] = {
+        {"UTC", fallBack + 5 * 3600},
+        {"Asia/Kolkata", fallBack + 5 * 3600},
+        {"Australia/Adelaide", fallBack - 20 * 86400},
+        {"Australia/Adelaide", fallBack + 12345},
+        {"Europe/Berlin", fallBack + 5 * 3600},
+        {"Europe/Berlin", fallBack + 1800},
+        {"America/St_Johns", fallBack + 10 * 86400},
+    };
+    int failed = 0;
+    for (const auto& c : cases) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            check_zone(c.zone, c.end);
+            fflush(stdout);
+            _exit(benchFailures > 0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("FAIL %s ending at %lld\n", c.zone, (long long)c.end);
+            failed++;
+        }
+    }
+    benchFailures += failed;
+    return bench_result("rollup_check");
+}
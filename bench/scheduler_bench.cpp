@@ -0,0 +1,93 @@
+// Resource use of the API scheduler: api_scheduler_t polls every endpoint against the local server
+// in bench/http for a while, then the thread count, memory and context switches of the process are
+// printed with the HTTP stats. Run with make bench-http.
+// usage: scheduler_bench [seconds]
+#include "bench.h"
+#include <curl/curl.h>
+#include <sys/resource.h>
+
+Weather weather;
+UV uv;
+Solar solar;
+std::mutex dataMutex;
+std::atomic<uint32_t> dataSequence{0};
+
+DataWriteGuard::DataWriteGuard() {
+    dataMutex.lock();
+    dataSequence.fetch_add(1, std::memory_order_release);
+}
+
+DataWriteGuard::~DataWriteGuard() {
+    dataSequence.fetch_add(1, std::memory_order_release);
+    dataMutex.unlock();
+}
+
+void record_sample(int series, time_t time, float value) {
+    (void)series;
+    (void)time;
+    (void)value;
+}
+
+// No token cache, so the first Solarman poll fetches one
+bool saveDataBlock(const char* filename, const void* data_ptr, size_t size, mode_t mode) {
+    (void)filename;
+    (void)data_ptr;
+    (void)size;
+    (void)mode;
+    return true;
+}
+
+bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size) {
+    (void)filename;
+    (void)data_ptr;
+    (void)expected_size;
+    return false;
+}
+
+// Every request goes to the local server whatever its host, linked in with --wrap
+static struct curl_slist* connectTo = NULL;
+extern "C" bool __real__Z10http_startPvS_(CURL* curl, void* owner);
+extern "C" bool __wrap__Z10http_startPvS_(CURL* curl, void* owner) {
+    curl_easy_setopt(curl, CURLOPT_CONNECT_TO, connectTo);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    return __real__Z10http_startPvS_(curl, owner);
+}
+
+int main(int argc, char** argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 60;
+    const char* port = getenv("BENCH_HTTP_PORT");
+    if (!port) {
+        printf("Run through bench/http/run.sh\n");
+        return 1;
+    }
+    char target[64];
+    snprintf(target, sizeof(target), "::127.0.0.1:%s", port);
+    connectTo = curl_slist_append(NULL, target);
+
+    http_init();
+    pthread_t thread;
+    pthread_create(&thread, NULL, api_scheduler_t, NULL);
+    sleep(seconds);
+
+    printf("after %d s\n", seconds);
+    char line[256];
+    FILE* status = fopen("/proc/self/status", "r");
+    while (status && fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "Threads:", 8) == 0 || strncmp(line, "VmSize:", 7) == 0 || strncmp(line, "VmRSS:", 6) == 0) {
+            printf("%s", line);
+        }
+    }
+    if (status) {
+        fclose(status);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Context switches: %ld voluntary, %ld involuntary, cpu %.3f s\n", usage.ru_nvcsw, usage.ru_nivcsw,
+           usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+    printf("Weather %.1f, UV %d, battery %.0f%%, bought today %.1f\n", weather.temperature, uv.index, solar.batteryCharge, solar.today_buy);
+    http_report_stats();
+    fflush(stdout);
+    // The scheduler thread never returns
+    _exit(0);
+}
@@ -0,0 +1,25 @@
+#include "globals.h"
+
+// The program's own versions publish over MQTT and draw on screen. A harness that links only a
+// few modules gets these instead, and can define its own to look at what was published.
+__attribute__((weak)) void logAndPublish(const char* messageBuffer) {
+    (void)messageBuffer;
+}
+
+__attribute__((weak)) void errorPublish(const char* messageBuffer) {
+    printf("%s\n", messageBuffer);
+}
+
+__attribute__((weak)) void statsPublish(const char* messageBuffer) {
+    printf("%s\n", messageBuffer);
+}
+
+__attribute__((weak)) void wakeDisplay() {
+}
+
+__attribute__((weak)) void markDataDirty(int section) {
+    (void)section;
+}
+
+__attribute__((weak)) void persistence_wake() {
+}
@@ -0,0 +1,60 @@
+// Routing cost of an MQTT topic to its sensor slot, the hash index in topics.cpp against the
+// strcmp scan it replaced, from a few dozen sensors up to thousands. One lookup in ten is a topic
+// no sensor has.
+#include "bench.h"
+#include <vector>
+
+int numberOfReadings = 0;
+std::mutex dataMutex;
+static std::vector<std::string> topics;
+
+const char* reading_topic(int index) {
+    return topics[index].c_str();
+}
+
+static int scan_find(const char* topic) {
+    for (int i = 0; i < numberOfReadings; i++) {
+        if (strcmp(topics[i].c_str(), topic) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main() {
+    const int lookups = 100000;
+    printf("%8s %14s %14s\n", "topics", "scan ns", "index ns");
+    for (int count : {32, 256, 1024, 4096}) {
+        topics.clear();
+        for (int i = 0; i < count; i++) {
+            char topic[96];
+            snprintf(topic, sizeof(topic), "zigbee2mqtt/room%04d/sensor/%s", i, i % 2 ? "temperature" : "humidity");
+            topics.push_back(topic);
+        }
+        numberOfReadings = count;
+        topic_index_build();
+
+        std::vector<std::string> queries;
+        for (int i = 0; i < lookups; i++) {
+            queries.push_back(i % 10 == 0 ? "zigbee2mqtt/unknown/sensor/temperature" : topics[(i * 7919) % count]);
+        }
+
+        long sink = 0;
+        double start = bench_now_us();
+        for (const std::string& query : queries) {
+            sink += scan_find(query.c_str());
+        }
+        double scanTime = bench_now_us() - start;
+        start = bench_now_us();
+        for (const std::string& query : queries) {
+            sink -= topic_index_find(query.c_str());
+        }
+        double indexTime = bench_now_us() - start;
+        if (sink != 0) {
+            printf("index and scan disagree\n");
+            return 1;
+        }
+        printf("%8d %14.1f %14.1f\n", count, scanTime * 1000 / lookups, indexTime * 1000 / lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Compression and cost of the history store (timeseries.cpp) on 30 days of minute samples of
+// each kind of series the program records, generated from fixed seeds: bytes per sample, the
+// ratio against 12 raw bytes (8 byte time, 4 byte float), append and scan time per sample.
+#include "bench.h"
+#include <random>
+#include <vector>
+
+static char dataDirectory[] = "/tmp/ts_bench.XXXXXX";
+
+void getDataFilePath(const char* filename, char* fullpath, size_t fullpath_size) {
+    snprintf(fullpath, fullpath_size, "%s/%s", dataDirectory, filename);
+}
+
+// Blocks in use, from the store's own stats line
+static unsigned long long blocksUsed = 0;
+void statsPublish(const char* messageBuffer) {
+    unsigned long long samples;
+    sscanf(messageBuffer, "History %llu samples stored, %llu of", &samples, &blocksUsed);
+}
+
+typedef struct {
+    const char* name;
+    std::vector<std::pair<time_t, float>> samples;
+} Fixture;
+
+static const int DAYS = 30;
+static const time_t START = 1760000000;
+
+// Room temperature to 0.1 degree, drifting, with a few seconds of jitter on the arrival time
+static Fixture temperature(std::mt19937* random) {
+    std::normal_distribution<float> step(0, 0.03f);
+    std::uniform_int_distribution<int> jitter(-2, 2);
+    Fixture fixture = {"temperature", {}};
+    float value = 20;
+    for (int i = 0; i < DAYS * 1440; i++) {
+        value += step(*random) + 0.02f * sinf(i * 2 * (float)M_PI / 1440);
+        fixture.samples.push_back({START + (time_t)i * 60 + jitter(*random), roundf(value * 10) / 10});
+    }
+    return fixture;
+}
+
+// Whole percent humidity, mostly unchanged from one minute to the next
+static Fixture humidity(std::mt19937* random) {
+    std::uniform_int_distribution<int> change(-1, 1);
+    std::uniform_int_distribution<int> jitter(-2, 2);
+    Fixture fixture = {"humidity", {}};
+    int value = 55;
+    for (int i = 0; i < DAYS * 1440; i++) {
+        if (i % 7 == 0) {
+            value = std::min(95, std::max(20, value + change(*random)));
+        }
+        fixture.samples.push_back({START + (time_t)i * 60 + jitter(*random), (float)value});
+    }
+    return fixture;
+}
+
+// Battery charge in whole percent, down overnight and up by day
+static Fixture battery(std::mt19937* random) {
+    (void)random;
+    Fixture fixture = {"battery charge", {}};
+    float value = 60;
+    for (int i = 0; i < DAYS * 1440; i++) {
+        int minute = i % 1440;
+        value = std::min(100.0f, std::max(10.0f, value + (minute > 420 && minute < 960 ? 0.15f : -0.04f)));
+        fixture.samples.push_back({START + (time_t)i * 60, floorf(value)});
+    }
+    return fixture;
+}
+
+// Solar power in kW to the watt, a daylight curve with cloud noise and zero at night
+static Fixture solar(std::mt19937* random) {
+    std::normal_distribution<float> cloud(0, 0.15f);
+    Fixture fixture = {"solar power", {}};
+    for (int i = 0; i < DAYS * 1440; i++) {
+        int minute = i % 1440;
+        float value = 0;
+        if (minute > 360 && minute < 1140) {
+            value = std::max(0.0f, 5.0f * sinf((minute - 360) * (float)M_PI / 780) + cloud(*random));
+        }
+        fixture.samples.push_back({START + (time_t)i * 60, roundf(value * 1000) / 1000});
+    }
+    return fixture;
+}
+
+// Random bit patterns, the worst case
+static Fixture noise(std::mt19937* random) {
+    Fixture fixture = {"noise", {}};
+    for (int i = 0; i < DAYS * 1440; i++) {
+        uint32_t bits = (*random)();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        fixture.samples.push_back({START + (time_t)i * 60, value});
+    }
+    return fixture;
+}
+
+static bool count_sample(time_t time, float value, void* context) {
+    (void)time;
+    *(double*)context += value == value ? value : 0;
+    return true;
+}
+
+int main() {
+    if (!mkdtemp(dataDirectory) || !ts_open()) {
+        printf("Cannot create the history file under /tmp\n");
+        return 1;
+    }
+    std::mt19937 random(1);
+    Fixture fixtures[] = {temperature(&random), humidity(&random), battery(&random), solar(&random), noise(&random)};
+
+    printf("%-16s %8s %10s %8s %10s %9s %9s\n", "series", "samples", "bytes/smp", "ratio", "days/MB", "append ns", "scan ns");
+    int series = TS_SERIES_READING(0);
+    for (const Fixture& fixture : fixtures) {
+        ts_report_stats();
+        unsigned long long blocksBefore = blocksUsed;
+        double start = bench_now_us();
+        for (const auto& s : fixture.samples) {
+            ts_append(series, s.first, s.second);
+        }
+        double appendTime = bench_now_us() - start;
+        ts_report_stats();
+
+        double sink = 0;
+        start = bench_now_us();
+        int scanned = ts_scan(series, 0, INT64_MAX, count_sample, &sink);
+        double scanTime = bench_now_us() - start;
+
+        size_t count = fixture.samples.size();
+        double bytes = (double)(blocksUsed - blocksBefore) * TS_BLOCK_SIZE / count;
+        printf("%-16s %8zu %10.2f %7.1fx %10.0f %9.1f %9.1f%s\n", fixture.name, count, bytes, 12 / bytes, 1024 * 1024 / (bytes * 1440), appendTime * 1000 / count,
+               scanTime * 1000 / scanned, scanned != (int)count ? " (not all samples scanned)" : "");
+        series++;
+    }
+
+    char filepath[512];
+    getDataFilePath(TS_FILENAME, filepath, sizeof(filepath));
+    unlink(filepath);
+    rmdir(dataDirectory);
+    return 0;
+}
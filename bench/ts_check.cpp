@@ -0,0 +1,160 @@
+// Round trip checks of the Gorilla encoder and decoder in timeseries.cpp: samples written with
+// ts_append() must come back from ts_scan() bit for bit, across every timestamp and value
+// encoding, block changes, reopening the file and the ring wrapping. Exits non-zero if not.
+#include "bench.h"
+#include <random>
+#include <vector>
+
+static char dataDirectory[] = "/tmp/ts_check.XXXXXX";
+
+void getDataFilePath(const char* filename, char* fullpath, size_t fullpath_size) {
+    snprintf(fullpath, fullpath_size, "%s/%s", dataDirectory, filename);
+}
+
+typedef struct {
+    time_t time;
+    uint32_t bits;
+} Sample;
+
+static Sample sample(time_t time, float value) {
+    Sample s = {time, 0};
+    memcpy(&s.bits, &value, sizeof(s.bits));
+    return s;
+}
+
+static bool collect(time_t time, float value, void* context) {
+    ((std::vector<Sample>*)context)->push_back(sample(time, value));
+    return true;
+}
+
+static std::vector<Sample> scan(int series, time_t from = INT64_MIN, time_t to = INT64_MAX) {
+    std::vector<Sample> samples;
+    ts_scan(series, from, to, collect, &samples);
+    return samples;
+}
+
+// Compare what came back with what went in, reporting the first difference
+static void check_same(const char* name, const std::vector<Sample>& got, const std::vector<Sample>& expected) {
+    CHECK(got.size() == expected.size(), "%s: %zu samples back, %zu written", name, got.size(), expected.size());
+    for (size_t i = 0; i < got.size() && i < expected.size(); i++) {
+        if (got[i].time != expected[i].time || got[i].bits != expected[i].bits) {
+            CHECK(false, "%s: sample %zu is %lld %08X, expected %lld %08X", name, i, (long long)got[i].time, got[i].bits, (long long)expected[i].time,
+                  expected[i].bits);
+            return;
+        }
+    }
+}
+
+static void append(int series, const std::vector<Sample>& samples) {
+    for (const Sample& s : samples) {
+        float value;
+        memcpy(&value, &s.bits, sizeof(value));
+        ts_append(series, s.time, value);
+    }
+}
+
+// Every delta-of-delta range, each at and just past its bounds, and gaps big enough to need a new block
+static std::vector<Sample> timestamp_cases() {
+    const int64_t steps[] = {60, 60, 60, 61, 59, 123, 60, 124, 1, 2, 258, 2, 259, 60, 2107, 60, 2108, 60, 100000, 60, 1, 1, 1, (int64_t)INT32_MAX + 10, 60, 3};
+    std::vector<Sample> samples;
+    time_t time = 1760000000;
+    float value = 20.0f;
+    for (int64_t step : steps) {
+        time += step;
+        value += 0.1f;
+        samples.push_back(sample(time, value));
+    }
+    return samples;
+}
+
+// Repeats, changes inside the last XOR window, wider ones, sign flips and the special values
+static std::vector<Sample> value_cases() {
+    const float values[] = {21.5f, 21.5f, 21.6f, 21.5f, 21.7f, -21.7f, 0.0f, -0.0f, 0.0f, 1e-40f, -1e-40f, 3.4e38f, INFINITY, -INFINITY, NAN, NAN, 1.0f, 1.0000001f,
+                            1.0f, 65535.0f, 0.001f, 1e9f, 1e-9f, 21.5f};
+    std::vector<Sample> samples;
+    time_t time = 1760000000;
+    for (float value : values) {
+        time += 60;
+        samples.push_back(sample(time, value));
+    }
+    return samples;
+}
+
+// A slowly changing sensor with jitter on its timestamps, long enough to fill several blocks
+static std::vector<Sample> sensor_samples(std::mt19937* random, int count, time_t start) {
+    std::normal_distribution<float> step(0, 0.05f);
+    std::uniform_int_distribution<int> jitter(-2, 2);
+    std::vector<Sample> samples;
+    float value = 18;
+    for (int i = 0; i < count; i++) {
+        value += step(*random);
+        samples.push_back(sample(start + (time_t)i * 60 + jitter(*random), roundf(value * 10) / 10));
+    }
+    return samples;
+}
+
+// Random bit patterns, the worst case for the value encoding
+static std::vector<Sample> noise_samples(std::mt19937* random, int count, time_t start) {
+    std::vector<Sample> samples;
+    for (int i = 0; i < count; i++) {
+        Sample s = {start + (time_t)i * 10, (uint32_t)(*random)()};
+        samples.push_back(s);
+    }
+    return samples;
+}
+
+int main() {
+    if (!mkdtemp(dataDirectory) || !ts_open()) {
+        printf("Cannot create the history file under /tmp\n");
+        return 1;
+    }
+    std::mt19937 random(1);
+
+    std::vector<Sample> timestamps = timestamp_cases();
+    append(TS_SERIES_SOLAR_POWER, timestamps);
+    check_same("timestamps", scan(TS_SERIES_SOLAR_POWER), timestamps);
+
+    std::vector<Sample> values = value_cases();
+    append(TS_SERIES_SOLAR_GRID, values);
+    check_same("values", scan(TS_SERIES_SOLAR_GRID), values);
+
+    // Older and repeated timestamps are dropped
+    std::vector<Sample> ordered = {sample(1000, 1), sample(1060, 2), sample(1120, 3)};
+    append(TS_SERIES_SOLAR_CHARGE, {ordered[0], ordered[1], sample(1060, 9), sample(1000, 9), ordered[2], sample(1100, 9)});
+    check_same("out of order", scan(TS_SERIES_SOLAR_CHARGE), ordered);
+
+    // Several blocks, interleaved with a second series, then a range from the middle
+    std::vector<Sample> sensor = sensor_samples(&random, 20000, 1760000000);
+    std::vector<Sample> other = sensor_samples(&random, 20000, 1760000000);
+    for (size_t i = 0; i < sensor.size(); i++) {
+        append(TS_SERIES_READING(0), {sensor[i]});
+        append(TS_SERIES_READING(1), {other[i]});
+    }
+    check_same("sensor", scan(TS_SERIES_READING(0)), sensor);
+    check_same("second sensor", scan(TS_SERIES_READING(1)), other);
+    time_t from = sensor[5000].time;
+    time_t to = sensor[6439].time;
+    check_same("range", scan(TS_SERIES_READING(0), from, to), std::vector<Sample>(sensor.begin() + 5000, sensor.begin() + 6440));
+
+    // Reopening rebuilds each encoder from its open block, appends must carry on from there
+    ts_sync();
+    ts_open();
+    std::vector<Sample> more = sensor_samples(&random, 3000, sensor.back().time + 60);
+    append(TS_SERIES_READING(0), more);
+    sensor.insert(sensor.end(), more.begin(), more.end());
+    check_same("after reopening", scan(TS_SERIES_READING(0)), sensor);
+    check_same("values after reopening", scan(TS_SERIES_SOLAR_GRID), values);
+
+    // More noise than the file holds, what is left must be the newest samples, in order
+    std::vector<Sample> noise = noise_samples(&random, 3000000, 1760000000);
+    append(TS_SERIES_READING(2), noise);
+    std::vector<Sample> kept = scan(TS_SERIES_READING(2));
+    CHECK(!kept.empty() && kept.size() < noise.size(), "wrapped: %zu of %zu samples kept", kept.size(), noise.size());
+    check_same("wrapped", kept, std::vector<Sample>(noise.end() - std::min(kept.size(), noise.size()), noise.end()));
+
+    char filepath[512];
+    getDataFilePath(TS_FILENAME, filepath, sizeof(filepath));
+    unlink(filepath);
+    rmdir(dataDirectory);
+    return bench_result("ts_check");
+}
@@ -1,6 +1,6 @@
 #include "globals.h"
+#include <cstddef>
 #include <curl/curl.h>
-#include <json-c/json.h>
 
 extern Weather weather;
 extern UV uv;
@@ -10,40 +10,76 @@ extern std::mutex dataMutex;
 // Token management - private to this file
 static std::mutex tokenMutex;
 static char solar_token[SOLAR_TOKEN_LENGTH+1] = {0};
+static time_t solarTokenExpires = 0; // 0 if the server gave no lifetime
+static time_t solarTokenRefresh = 0; // When to log in again while the token still works
+
+// Solarman token as cached on disk, so a restart does not log in again
+struct SolarTokenCache {
+    uint32_t account; // Token is only reused for the app id and user it was issued to
+    int64_t expires;
+    int64_t refresh;
+    char token[SOLAR_TOKEN_LENGTH + 1];
+};
 
 // Buffer sizes
 static const size_t URL_BUFFER_SIZE = 512;
 static const size_t POST_BUFFER_SIZE = 1024;
 
-// Callback structure for libcurl
-struct MemoryStruct {
-    char* memory;
-    size_t size;
+// One data source polled by the API scheduler. The engine below does the scheduling, request,
+// response checks, logging and saving, an endpoint only says what to ask for and what to keep.
+struct ApiEndpoint {
+    const char* name;                                // Used in log messages, "<name> updated"
+    int source;                                      // Status indicator it counts towards, API_SOURCE_*
+    int intervalSec;                                 // Age of the data before it is fetched again
+    bool needsToken;                                 // Sends the Solarman bearer token, waits until there is one
+    bool (*ready)(time_t now);                       // Optional, checked before the interval, false skips this pass
+    void (*build)(char* url, char* post, time_t now); // URL_BUFFER_SIZE url and POST_BUFFER_SIZE body, an empty body is a GET
+    const char* const* fields;                       // JSON paths the parser reads, only these are kept from the response
+    int fieldCount;
+    bool (*parse)(const JsonStream* json);           // Applies the response, false if it held no usable data
+    int section;                                     // State section saved after an update, -1 for none
+    const void* state;                               // Struct holding the last update time, NULL if not interval driven
+    size_t updateTimeOffset;                         // Offset of the last update time in state
+};
+
+// Per-endpoint request state, only touched by the scheduler thread
+struct ApiRequest {
+    CURL* curl;                            // Kept across requests, see http_handle()
+    struct curl_slist* headers;            // Request headers, only rebuilt when the token changes
+    char headerToken[SOLAR_TOKEN_LENGTH];  // Token the headers were built with
+    JsonStream json;                       // Fields pulled from the response as it arrives
+    Arena text;                            // String values of the response, reused by every request
+    size_t received;                       // Response body bytes
+    char post[POST_BUFFER_SIZE]; // Request body, curl reads it during the transfer
+    time_t nextDue;
+    bool inFlight;
+    int failures;                // Failed updates in a row, API_BREAKER_FAILURES or more is an open circuit
+    bool waitingForToken;        // Due again as soon as there is a Solarman token
+    std::atomic<int> status;     // STATUS_*, read by the UI thread
 };
 
-// Callback function to receive HTTP response data
-static size_t WriteMemoryCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+// Response data goes straight into the endpoint's JSON extractor, the body itself is not kept
+static size_t json_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
     size_t realsize = size * nmemb;
-    struct MemoryStruct* mem = (struct MemoryStruct*)userp;
+    ApiRequest* request = (ApiRequest*)userp;
 
-    char* ptr = (char*)realloc(mem->memory, mem->size + realsize + 1);
-    if (!ptr) {
-        printf("Not enough memory (realloc returned NULL)\n");
-        return 0;
+    curl_off_t content_length = -1;
+    if (request->received == 0) {
+        curl_easy_getinfo(request->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length);
     }
-
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
-
+    json_stream_receive(&request->json, (const char*)contents, realsize, request->received, content_length);
+    request->received += realsize;
     return realsize;
 }
 
-// Token helper functions
+// Token helper functions, an expired token counts as none
+static bool solar_token_valid(time_t now) {
+    return solar_token[0] != '\0' && (solarTokenExpires == 0 || now < solarTokenExpires);
+}
+
 static bool get_solar_token_copy(char* dest, size_t dest_size) {
     std::lock_guard<std::mutex> lock(tokenMutex);
-    bool has_token = (strlen(solar_token) > 0);
+    bool has_token = solar_token_valid(time(NULL));
     if (has_token) {
         strncpy(dest, solar_token, dest_size - 1);
         dest[dest_size - 1] = '\0';
@@ -51,44 +87,73 @@ static bool get_solar_token_copy(char* dest, size_t dest_size) {
     return has_token;
 }
 
-static void set_solar_token(const char* token) {
+static bool has_solar_token(void) {
     std::lock_guard<std::mutex> lock(tokenMutex);
-    snprintf(solar_token, SOLAR_TOKEN_LENGTH, "bearer %s", token);
+    return solar_token_valid(time(NULL));
 }
 
-static void clear_solar_token(void) {
-    std::lock_guard<std::mutex> lock(tokenMutex);
-    solar_token[0] = '\0';
+static uint32_t solar_token_account(void) {
+    char account[CHAR_LEN];
+    snprintf(account, sizeof(account), "%s:%s", SOLAR_APPID, SOLAR_USERNAME);
+    return crc32c(account, strlen(account));
 }
 
-static bool has_solar_token(void) {
-    std::lock_guard<std::mutex> lock(tokenMutex);
-    bool has_token = (strlen(solar_token) > 0);
-    return has_token;
+// Write the current token to SOLAR_TOKEN_FILENAME, owner read only as it is a login
+static void save_solar_token(void) {
+    SolarTokenCache cache = {};
+    {
+        std::lock_guard<std::mutex> lock(tokenMutex);
+        cache.account = solar_token_account();
+        cache.expires = solarTokenExpires;
+        cache.refresh = solarTokenRefresh;
+        memcpy(cache.token, solar_token, sizeof(cache.token));
+    }
+    if (!saveDataBlock(SOLAR_TOKEN_FILENAME, &cache, sizeof(cache), 0600)) {
+        errorPublish("Failed to save solar token");
+    }
 }
 
-// Helper to initialise curl with common settings
-static CURL* init_curl_request(const char* url, struct MemoryStruct* chunk) {
-    chunk->memory = (char*)malloc(1);
-    if (!chunk->memory) {
-        return NULL;
+// Reuse the token from the last run if it is for this account and has not expired
+static void load_solar_token(void) {
+    SolarTokenCache cache;
+    if (!loadDataBlock(SOLAR_TOKEN_FILENAME, &cache, sizeof(cache))) {
+        return;
     }
-    chunk->size = 0;
-
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        free(chunk->memory);
-        chunk->memory = NULL;
-        return NULL;
+    cache.token[SOLAR_TOKEN_LENGTH] = '\0';
+    if (cache.account != solar_token_account() || cache.token[0] == '\0') {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(tokenMutex);
+    memcpy(solar_token, cache.token, sizeof(solar_token));
+    solarTokenExpires = (time_t)cache.expires;
+    solarTokenRefresh = (time_t)cache.refresh;
+    if (solar_token_valid(time(NULL))) {
+        logAndPublish("Solar token loaded");
+    } else {
+        solar_token[0] = '\0';
     }
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)chunk);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+// A new token, refreshed SOLAR_TOKEN_REFRESH_SEC before it expires or half way for a short lived one
+static void set_solar_token(const char* token, long expires_in) {
+    {
+        std::lock_guard<std::mutex> lock(tokenMutex);
+        time_t now = time(NULL);
+        snprintf(solar_token, SOLAR_TOKEN_LENGTH, "bearer %s", token);
+        solarTokenExpires = expires_in > 0 ? now + expires_in : 0;
+        solarTokenRefresh = expires_in > 0 ? solarTokenExpires - std::min(expires_in / 2, (long)SOLAR_TOKEN_REFRESH_SEC) : 0;
+    }
+    save_solar_token();
+}
 
-    return curl;
+static void clear_solar_token(void) {
+    {
+        std::lock_guard<std::mutex> lock(tokenMutex);
+        solar_token[0] = '\0';
+        solarTokenExpires = 0;
+        solarTokenRefresh = 0;
+    }
+    save_solar_token();
 }
 
 // Helper to get current time string
@@ -99,238 +164,6 @@ static void get_current_time_string(char* buffer, size_t buffer_size) {
     strftime(buffer, buffer_size, "%H:%M:%S", &local_time);
 }
 
-// Get UV from weatherbit.io
-void* get_uv_t(void* pvParameters) {
-    (void)pvParameters;
-
-    while (true) {
-        bool is_day;
-        time_t last_update;
-
-        // Read shared state
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            is_day = weather.isDay;
-            last_update = uv.updateTime;
-        }
-
-        if (is_day) {
-            if (time(NULL) - last_update > UV_UPDATE_INTERVAL_SEC) {
-                char url_buffer[URL_BUFFER_SIZE];
-                snprintf(url_buffer, URL_BUFFER_SIZE,
-                         "https://api.weatherbit.io/v2.0/current?city_id=%s&key=%s",
-                         WEATHERBIT_CITY_ID, WEATHERBIT_API);
-
-                struct MemoryStruct chunk;
-                CURL* curl = init_curl_request(url_buffer, &chunk);
-
-                if (curl) {
-                    CURLcode res = curl_easy_perform(curl);
-
-                    if (res == CURLE_OK) {
-                        long response_code;
-                        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                        if (response_code == 200 && chunk.size > 0) {
-                            struct json_object* root = json_tokener_parse(chunk.memory);
-
-                            if (root != NULL) {
-                                struct json_object* data_array;
-                                if (json_object_object_get_ex(root, "data", &data_array)) {
-                                    struct json_object* first_element = json_object_array_get_idx(data_array, 0);
-                                    if (first_element) {
-                                        struct json_object* uv_obj;
-                                        if (json_object_object_get_ex(first_element, "uv", &uv_obj)) {
-                                            float uv_value = json_object_get_double(uv_obj);
-                                            char time_string[CHAR_LEN];
-                                            get_current_time_string(time_string, sizeof(time_string));
-
-                                            {
-                                                std::lock_guard<std::mutex> lock(dataMutex);
-                                                uv.index = uv_value;
-                                                uv.updateTime = time(NULL);
-                                                strncpy(uv.time_string, time_string, CHAR_LEN - 1);
-                                                uv.time_string[CHAR_LEN - 1] = '\0';
-                                            }
-
-                                            logAndPublish("UV updated");
-                                            saveDataBlock(UV_DATA_FILENAME, &uv, sizeof(uv));
-                                        }
-                                    }
-                                }
-                                json_object_put(root);
-                            } else {
-                                logAndPublish("UV update failed: JSON parse error");
-                                {
-                                    std::lock_guard<std::mutex> lock(dataMutex);
-                                    uv.updateTime = time(NULL);
-                                }
-                            }
-                        } else {
-                            char log_message[CHAR_LEN];
-                            snprintf(log_message, CHAR_LEN, "[HTTP] GET UV failed, response code: %ld", response_code);
-                            errorPublish(log_message);
-                            logAndPublish("UV update failed");
-                            usleep(API_FAIL_DELAY_SEC * 1000000);
-                        }
-                    } else {
-                        char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN, "[HTTP] GET UV failed: %s", curl_easy_strerror(res));
-                        errorPublish(log_message);
-                        logAndPublish("UV update failed");
-                        usleep(API_FAIL_DELAY_SEC * 1000000);
-                    }
-
-                    free(chunk.memory);
-                    curl_easy_cleanup(curl);
-                }
-            }
-        } else {
-            // Night time - set UV to 0
-            time_t weather_update;
-            {
-                std::lock_guard<std::mutex> lock(dataMutex);
-                weather_update = weather.updateTime;
-            }
-
-            char time_string[CHAR_LEN];
-            get_current_time_string(time_string, sizeof(time_string));
-
-            {
-                std::lock_guard<std::mutex> lock(dataMutex);
-                uv.index = 0.0;
-                if (weather_update > 0) {
-                    uv.updateTime = time(NULL);
-                }
-                strncpy(uv.time_string, time_string, CHAR_LEN - 1);
-                uv.time_string[CHAR_LEN - 1] = '\0';
-            }
-
-            saveDataBlock(UV_DATA_FILENAME, &uv, sizeof(uv));
-        }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
-    }
-    return NULL;
-}
-
-void* get_weather_t(void* pvParameters) {
-    (void)pvParameters;
-
-    while (true) {
-        time_t last_update;
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            last_update = weather.updateTime;
-        }
-
-        if (time(NULL) - last_update > WEATHER_UPDATE_INTERVAL_SEC) {
-            char url_buffer[URL_BUFFER_SIZE];
-            snprintf(url_buffer, URL_BUFFER_SIZE,
-                     "https://api.open-meteo.com/v1/"
-                     "forecast?latitude=%s&longitude=%s&daily="
-                     "temperature_2m_max,temperature_2m_min,sunrise,sunset,uv_index_max"
-                     "&models=ukmo_uk_deterministic_2km,ncep_gfs013"
-                     "&current=temperature_2m,is_day,weather_code,wind_speed_10m,wind_direction_10m"
-                     "&timezone=auto&forecast_days=1",
-                     LATITUDE, LONGITUDE);
-
-            struct MemoryStruct chunk;
-            CURL* curl = init_curl_request(url_buffer, &chunk);
-
-            if (curl) {
-                CURLcode res = curl_easy_perform(curl);
-
-                if (res == CURLE_OK) {
-                    long response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                    if (response_code == 200 && chunk.size > 0) {
-                        struct json_object* root = json_tokener_parse(chunk.memory);
-
-                        if (root != NULL) {
-                            struct json_object *current_obj, *daily_obj;
-
-                            if (json_object_object_get_ex(root, "current", &current_obj) &&
-                                json_object_object_get_ex(root, "daily", &daily_obj)) {
-
-                                struct json_object *temp_obj, *wind_dir_obj, *wind_speed_obj;
-                                struct json_object *is_day_obj, *weather_code_obj;
-
-                                json_object_object_get_ex(current_obj, "temperature_2m", &temp_obj);
-                                json_object_object_get_ex(current_obj, "wind_direction_10m", &wind_dir_obj);
-                                json_object_object_get_ex(current_obj, "wind_speed_10m", &wind_speed_obj);
-                                json_object_object_get_ex(current_obj, "is_day", &is_day_obj);
-                                json_object_object_get_ex(current_obj, "weather_code", &weather_code_obj);
-
-                                struct json_object *max_temp_array, *min_temp_array;
-                                json_object_object_get_ex(daily_obj, "temperature_2m_max", &max_temp_array);
-                                json_object_object_get_ex(daily_obj, "temperature_2m_min", &min_temp_array);
-
-                                if (temp_obj && wind_dir_obj && wind_speed_obj && is_day_obj &&
-                                    weather_code_obj && max_temp_array && min_temp_array) {
-
-                                    float weatherTemperature = json_object_get_double(temp_obj);
-                                    float weatherWindDir = json_object_get_double(wind_dir_obj);
-                                    float weatherWindSpeed = json_object_get_double(wind_speed_obj);
-                                    bool weatherIsDay = json_object_get_boolean(is_day_obj);
-                                    int weatherCode = json_object_get_int(weather_code_obj);
-
-                                    struct json_object* max_temp_0 = json_object_array_get_idx(max_temp_array, 0);
-                                    struct json_object* min_temp_0 = json_object_array_get_idx(min_temp_array, 0);
-                                    float weatherMaxTemp = json_object_get_double(max_temp_0);
-                                    float weatherMinTemp = json_object_get_double(min_temp_0);
-
-                                    const char* description = wmoToText(weatherCode, weatherIsDay);
-                                    const char* windDir = degreesToDirection(weatherWindDir);
-                                    char time_string[CHAR_LEN];
-                                    get_current_time_string(time_string, sizeof(time_string));
-
-                                    {
-                                        std::lock_guard<std::mutex> lock(dataMutex);
-                                        weather.temperature = weatherTemperature;
-                                        weather.windSpeed = weatherWindSpeed;
-                                        weather.maxTemp = weatherMaxTemp;
-                                        weather.minTemp = weatherMinTemp;
-                                        weather.isDay = weatherIsDay;
-                                        snprintf(weather.description, CHAR_LEN, "%s", description);
-                                        snprintf(weather.windDir, CHAR_LEN, "%s", windDir);
-                                        weather.updateTime = time(NULL);
-                                        strncpy(weather.time_string, time_string, CHAR_LEN - 1);
-                                        weather.time_string[CHAR_LEN - 1] = '\0';
-                                    }
-
-                                    logAndPublish("Weather updated");
-                                    saveDataBlock(WEATHER_DATA_FILENAME, &weather, sizeof(weather));
-                                }
-                            }
-                            json_object_put(root);
-                        } else {
-                            logAndPublish("Weather update failed: JSON parse error");
-                        }
-                    } else {
-                        char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN, "[HTTP] GET weather failed, response code: %ld", response_code);
-                        errorPublish(log_message);
-                        logAndPublish("Weather update failed");
-                        usleep(API_FAIL_DELAY_SEC * 1000000);
-                    }
-                } else {
-                    char log_message[CHAR_LEN];
-                    snprintf(log_message, CHAR_LEN, "[HTTP] GET weather failed: %s", curl_easy_strerror(res));
-                    errorPublish(log_message);
-                    logAndPublish("Weather update failed");
-                    usleep(API_FAIL_DELAY_SEC * 1000000);
-                }
-
-                free(chunk.memory);
-                curl_easy_cleanup(curl);
-            }
-        }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
-    }
-    return NULL;
-}
-
 const char* degreesToDirection(double degrees) {
     degrees = fmod(degrees, 360.0);
     if (degrees < 0) {
@@ -424,452 +257,591 @@ const char* wmoToText(int code, bool isDay) {
     }
 }
 
-void* get_solar_token_t(void* pvParameters) {
-    (void)pvParameters;
-
-    while (true) {
-        if (!has_solar_token()) {
-            char url_buffer[URL_BUFFER_SIZE];
-            char post_buffer[POST_BUFFER_SIZE];
-
-            snprintf(url_buffer, sizeof(url_buffer),
-                     "https://%s/account/v1.0/token?appId=%s",
-                     SOLAR_URL, SOLAR_APPID);
-
-            snprintf(post_buffer, POST_BUFFER_SIZE,
-                     "{\"appSecret\":\"%s\",\"email\":\"%s\",\"password\":\"%s\"}",
-                     SOLAR_SECRET, SOLAR_USERNAME, SOLAR_PASSHASH);
-
-            struct MemoryStruct chunk;
-            CURL* curl = init_curl_request(url_buffer, &chunk);
-
-            if (curl) {
-                struct curl_slist* headers = NULL;
-                headers = curl_slist_append(headers, "Content-Type: application/json");
-
-                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_buffer);
-
-                CURLcode res = curl_easy_perform(curl);
-
-                if (res == CURLE_OK) {
-                    long response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                    if (response_code == 200 && chunk.size > 0) {
-                        struct json_object* root = json_tokener_parse(chunk.memory);
-
-                        if (root != NULL) {
-                            struct json_object* token_obj;
-                            if (json_object_object_get_ex(root, "access_token", &token_obj)) {
-                                if (json_object_is_type(token_obj, json_type_string)) {
-                                    const char* rec_token = json_object_get_string(token_obj);
-                                    set_solar_token(rec_token);
-                                    logAndPublish("Solar token obtained");
-                                }
-                            } else {
-                                struct json_object* msg_obj;
-                                if (json_object_object_get_ex(root, "msg", &msg_obj)) {
-                                    char log_message[CHAR_LEN];
-                                    snprintf(log_message, CHAR_LEN, "Solar token error: %s",
-                                             json_object_get_string(msg_obj));
-                                    errorPublish(log_message);
-                                }
-                            }
-                            json_object_put(root);
-                        }
-                    } else {
-                        char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN,
-                                 "[HTTP] GET solar token failed, response code: %ld", response_code);
-                        errorPublish(log_message);
-                    }
-                } else {
-                    char log_message[CHAR_LEN];
-                    snprintf(log_message, CHAR_LEN, "[HTTP] GET solar token failed: %s",
-                             curl_easy_strerror(res));
-                    errorPublish(log_message);
-                }
+// UV from weatherbit.io, only used when UV_WEATHERBIT_FALLBACK is set and Open-Meteo has not sent
+// the UV with the weather for UV_UPDATE_INTERVAL_SEC. Only fetched by day, at night it is set to 0
+// without a request.
+static bool uv_ready(time_t now) {
+    if (!UV_WEATHERBIT_FALLBACK) {
+        return false;
+    }
+    bool is_day;
+    time_t weather_update;
+    time_t uv_update;
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        is_day = weather.isDay;
+        weather_update = weather.updateTime;
+        memcpy(&uv_update, &uv.updateTime, sizeof(uv_update));
+    }
+    if (now - uv_update <= UV_UPDATE_INTERVAL_SEC) {
+        return false;
+    }
+    if (is_day) {
+        return true;
+    }
 
-                free(chunk.memory);
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
-            }
+    char time_string[CHAR_LEN];
+    get_current_time_string(time_string, sizeof(time_string));
+    {
+        DataWriteGuard publish;
+        uv.index = 0.0;
+        if (weather_update > 0) {
+            uv.updateTime = now;
         }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
+        strncpy(uv.time_string, time_string, CHAR_LEN - 1);
+        uv.time_string[CHAR_LEN - 1] = '\0';
+        uv.generation++;
     }
-    return NULL;
+    wakeDisplay();
+    markDataDirty(STATE_SECTION_UV);
+    return false;
 }
 
-// Get current solar values from Solarman
-void* get_current_solar_t(void* pvParameters) {
-    (void)pvParameters;
+static void uv_build(char* url, char* post, time_t now) {
+    (void)post;
+    (void)now;
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://api.weatherbit.io/v2.0/current?city_id=%s&key=%s",
+             WEATHERBIT_CITY_ID, WEATHERBIT_API);
+}
 
-    while (true) {
-        time_t last_update;
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            last_update = solar.currentUpdateTime;
-        }
+static const char* const uvFields[] = {"data[0].uv"};
 
-        if (time(NULL) - last_update > SOLAR_CURRENT_UPDATE_INTERVAL_SEC) {
-            char local_token[SOLAR_TOKEN_LENGTH];
-            if (!get_solar_token_copy(local_token, sizeof(local_token))) {
-                usleep(SOLAR_TOKEN_WAIT_SEC * 1000000);
-                continue;
-            }
+static bool uv_parse(const JsonStream* json) {
+    double uv_value;
+    if (!json_stream_number(json, "data[0].uv", &uv_value)) {
+        return false;
+    }
 
-            char url_buffer[URL_BUFFER_SIZE];
-            char post_buffer[POST_BUFFER_SIZE];
+    char time_string[CHAR_LEN];
+    get_current_time_string(time_string, sizeof(time_string));
 
-            snprintf(url_buffer, URL_BUFFER_SIZE,
-                     "https://%s/station/v1.0/realTime?language=en", SOLAR_URL);
+    DataWriteGuard publish;
+    uv.index = uv_value;
+    uv.updateTime = time(NULL);
+    strncpy(uv.time_string, time_string, CHAR_LEN - 1);
+    uv.time_string[CHAR_LEN - 1] = '\0';
+    uv.generation++;
+    return true;
+}
 
-            snprintf(post_buffer, POST_BUFFER_SIZE,
-                     "{\"stationId\":\"%s\"}", SOLAR_STATIONID);
+// Current conditions, today's forecast and the UV from Open-Meteo, one request for both panels
+static void weather_build(char* url, char* post, time_t now) {
+    (void)post;
+    (void)now;
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://api.open-meteo.com/v1/"
+             "forecast?latitude=%s&longitude=%s&daily="
+             "temperature_2m_max,temperature_2m_min,sunrise,sunset,uv_index_max"
+             "&models=ukmo_uk_deterministic_2km,ncep_gfs013"
+             "&current=temperature_2m,is_day,weather_code,wind_speed_10m,wind_direction_10m,uv_index"
+             "&hourly=uv_index"
+             "&timezone=auto&forecast_days=1",
+             LATITUDE, LONGITUDE);
+}
 
-            struct MemoryStruct chunk;
-            CURL* curl = init_curl_request(url_buffer, &chunk);
+#define UV_HOUR(hour) "hourly.uv_index[" #hour "]"
+#define UV_HOUR_FIELDS                                                                                                                                                  \
+    UV_HOUR(0), UV_HOUR(1), UV_HOUR(2), UV_HOUR(3), UV_HOUR(4), UV_HOUR(5), UV_HOUR(6), UV_HOUR(7), UV_HOUR(8), UV_HOUR(9), UV_HOUR(10), UV_HOUR(11), UV_HOUR(12),    \
+        UV_HOUR(13), UV_HOUR(14), UV_HOUR(15), UV_HOUR(16), UV_HOUR(17), UV_HOUR(18), UV_HOUR(19), UV_HOUR(20), UV_HOUR(21), UV_HOUR(22), UV_HOUR(23)
 
-            if (curl) {
-                struct curl_slist* headers = NULL;
-                headers = curl_slist_append(headers, "Content-Type: application/json");
+static const char* const weatherFields[] = {
+    "current.temperature_2m", "current.wind_direction_10m", "current.wind_speed_10m", "current.is_day", "current.weather_code",
+    "daily.temperature_2m_max[0]", "daily.temperature_2m_min[0]", "current.time", "current.uv_index",
+    UV_HOUR_FIELDS,
+};
 
-                char auth_header[SOLAR_TOKEN_LENGTH + 20];
-                snprintf(auth_header, sizeof(auth_header), "Authorization: %s", local_token);
-                headers = curl_slist_append(headers, auth_header);
-
-                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_buffer);
-
-                CURLcode res = curl_easy_perform(curl);
-
-                if (res == CURLE_OK) {
-                    long response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                    if (response_code == 200 && chunk.size > 0) {
-                        struct json_object* root = json_tokener_parse(chunk.memory);
-
-                        if (root != NULL) {
-                            struct json_object* success_obj;
-                            if (json_object_object_get_ex(root, "success", &success_obj)) {
-                                bool rec_success = json_object_get_boolean(success_obj);
-
-                                if (rec_success) {
-                                    struct json_object *battery_soc_obj, *use_power_obj, *wire_power_obj;
-                                    struct json_object *battery_power_obj, *last_update_obj, *generation_power_obj;
-
-                                    json_object_object_get_ex(root, "batterySoc", &battery_soc_obj);
-                                    json_object_object_get_ex(root, "usePower", &use_power_obj);
-                                    json_object_object_get_ex(root, "wirePower", &wire_power_obj);
-                                    json_object_object_get_ex(root, "batteryPower", &battery_power_obj);
-                                    json_object_object_get_ex(root, "lastUpdateTime", &last_update_obj);
-                                    json_object_object_get_ex(root, "generationPower", &generation_power_obj);
-
-                                    if (battery_soc_obj && use_power_obj && wire_power_obj &&
-                                        battery_power_obj && last_update_obj && generation_power_obj) {
-
-                                        float rec_batteryCharge = json_object_get_double(battery_soc_obj);
-                                        float rec_usingPower = json_object_get_double(use_power_obj);
-                                        float rec_gridPower = json_object_get_double(wire_power_obj);
-                                        float rec_batteryPower = json_object_get_double(battery_power_obj);
-                                        time_t rec_time = (time_t)json_object_get_int64(last_update_obj);
-                                        float rec_solarPower = json_object_get_double(generation_power_obj);
-
-                                        struct tm ts;
-                                        char time_buf[CHAR_LEN];
-                                        localtime_r(&rec_time, &ts);
-                                        strftime(time_buf, sizeof(time_buf), "%H:%M:%S", &ts);
-
-                                        {
-                                            std::lock_guard<std::mutex> lock(dataMutex);
-                                            solar.currentUpdateTime = time(NULL);
-                                            solar.solarPower = rec_solarPower / 1000;
-                                            solar.batteryPower = rec_batteryPower / 1000;
-                                            solar.usingPower = rec_usingPower / 1000;
-                                            solar.batteryCharge = rec_batteryCharge;
-                                            solar.gridPower = rec_gridPower / 1000;
-                                            snprintf(solar.time, CHAR_LEN, "%s", time_buf);
-                                        }
-
-                                        logAndPublish("Solar status updated");
-                                        saveDataBlock(SOLAR_DATA_FILENAME, &solar, sizeof(solar));
-                                    }
-                                } else {
-                                    struct json_object* msg_obj;
-                                    if (json_object_object_get_ex(root, "msg", &msg_obj)) {
-                                        const char* msg = json_object_get_string(msg_obj);
-                                        if (msg && strcmp(msg, "auth invalid token") == 0) {
-                                            logAndPublish("Solar token expired, clearing for refresh");
-                                            clear_solar_token();
-                                        } else {
-                                            char log_message[CHAR_LEN];
-                                            snprintf(log_message, CHAR_LEN, "Solar status failed: %s", msg);
-                                            errorPublish(log_message);
-                                        }
-                                    }
-                                }
-                            }
-                            json_object_put(root);
-                        } else {
-                            logAndPublish("Solar status update failed: JSON parse error");
-                        }
-                    } else {
-                        char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN,
-                                 "[HTTP] GET solar status failed, response code: %ld", response_code);
-                        errorPublish(log_message);
-                        usleep(API_FAIL_DELAY_SEC * 1000000);
-                    }
-                } else {
-                    char log_message[CHAR_LEN];
-                    snprintf(log_message, CHAR_LEN, "[HTTP] GET solar status failed: %s",
-                             curl_easy_strerror(res));
-                    errorPublish(log_message);
-                    usleep(API_FAIL_DELAY_SEC * 1000000);
-                }
+// Today's hourly UV, hours the model has no value for (null) are 0. The hour of the current time,
+// "2026-10-17T14:00" in local time, stands in for a current UV the model does not have. False if
+// neither is there, so the UV is left to age and the Weatherbit fallback can take over.
+static bool weather_parse_uv(const JsonStream* json, float* hourly, double* uv_value) {
+    static const char* const hourPaths[UV_HOURS] = {UV_HOUR_FIELDS};
+    bool hour_found[UV_HOURS];
+    for (int hour = 0; hour < UV_HOURS; hour++) {
+        double value = 0;
+        hour_found[hour] = json_stream_number(json, hourPaths[hour], &value);
+        hourly[hour] = value;
+    }
+    if (json_stream_number(json, "current.uv_index", uv_value)) {
+        return true;
+    }
+    const char* current_time = json_stream_string(json, "current.time");
+    if (!current_time || strlen(current_time) < 13) {
+        return false;
+    }
+    int hour = atoi(current_time + 11);
+    if (hour < 0 || hour >= UV_HOURS || !hour_found[hour]) {
+        return false;
+    }
+    *uv_value = hourly[hour];
+    return true;
+}
 
-                free(chunk.memory);
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
-            }
+static bool weather_parse(const JsonStream* json) {
+    double temperature, wind_dir, wind_speed, is_day, weather_code, max_temp, min_temp;
+    if (!json_stream_number(json, "current.temperature_2m", &temperature) ||
+        !json_stream_number(json, "current.wind_direction_10m", &wind_dir) ||
+        !json_stream_number(json, "current.wind_speed_10m", &wind_speed) ||
+        !json_stream_number(json, "current.is_day", &is_day) ||
+        !json_stream_number(json, "current.weather_code", &weather_code) ||
+        !json_stream_number(json, "daily.temperature_2m_max[0]", &max_temp) ||
+        !json_stream_number(json, "daily.temperature_2m_min[0]", &min_temp)) {
+        return false;
+    }
+
+    float weatherTemperature = temperature;
+    float weatherMaxTemp = max_temp;
+    float weatherMinTemp = min_temp;
+    bool weatherIsDay = is_day != 0;
+    const char* description = wmoToText((int)weather_code, weatherIsDay);
+    const char* windDir = degreesToDirection(wind_dir);
+    char time_string[CHAR_LEN];
+    get_current_time_string(time_string, sizeof(time_string));
+    float hourly_uv[UV_HOURS];
+    double uv_value;
+    bool have_uv = weather_parse_uv(json, hourly_uv, &uv_value);
+
+    {
+        DataWriteGuard publish;
+        if (have_uv) {
+            uv.index = uv_value;
+            uv.updateTime = time(NULL);
+            strncpy(uv.time_string, time_string, CHAR_LEN - 1);
+            uv.time_string[CHAR_LEN - 1] = '\0';
+            memcpy(uv.hourly, hourly_uv, sizeof(uv.hourly));
+            uv.generation++;
         }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
+        weather.temperature = weatherTemperature;
+        weather.windSpeed = wind_speed;
+        // Forecast range can lag the current temperature, widen it so the arc stays in range
+        weather.maxTemp = fmax(weatherMaxTemp, weatherTemperature);
+        weather.minTemp = fmin(weatherMinTemp, weatherTemperature);
+        weather.isDay = weatherIsDay;
+        snprintf(weather.description, CHAR_LEN, "%s", description);
+        snprintf(weather.windDir, CHAR_LEN, "%s", windDir);
+        weather.updateTime = time(NULL);
+        strncpy(weather.time_string, time_string, CHAR_LEN - 1);
+        weather.time_string[CHAR_LEN - 1] = '\0';
+        weather.generation++;
     }
-    return NULL;
+    // Saved here as the engine only saves the weather section
+    if (have_uv) {
+        markDataDirty(STATE_SECTION_UV);
+    }
+    return true;
 }
 
-// Get daily solar values from Solarman
-void* get_daily_solar_t(void* pvParameters) {
-    (void)pvParameters;
+// Solarman login, run while there is no token and ahead of its expiry. The old token stays in use until the new one arrives.
+static bool solar_token_ready(time_t now) {
+    std::lock_guard<std::mutex> lock(tokenMutex);
+    return !solar_token_valid(now) || (solarTokenRefresh != 0 && now >= solarTokenRefresh);
+}
 
-    while (true) {
-        time_t last_update;
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            last_update = solar.dailyUpdateTime;
-        }
+static void solar_token_build(char* url, char* post, time_t now) {
+    (void)now;
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://%s/account/v1.0/token?appId=%s",
+             SOLAR_URL, SOLAR_APPID);
+    snprintf(post, POST_BUFFER_SIZE,
+             "{\"appSecret\":\"%s\",\"email\":\"%s\",\"password\":\"%s\"}",
+             SOLAR_SECRET, SOLAR_USERNAME, SOLAR_PASSHASH);
+}
 
-        if (time(NULL) - last_update > SOLAR_DAILY_UPDATE_INTERVAL_SEC) {
-            char local_token[SOLAR_TOKEN_LENGTH];
-            if (!get_solar_token_copy(local_token, sizeof(local_token))) {
-                usleep(SOLAR_TOKEN_WAIT_SEC * 1000000);
-                continue;
-            }
+static const char* const solarTokenFields[] = {"access_token", "expires_in", "msg"};
+
+static bool solar_token_parse(const JsonStream* json) {
+    const char* token = json_stream_string(json, "access_token");
+    if (token) {
+        double expires_in = 0; // Seconds, sent as a string
+        json_stream_number(json, "expires_in", &expires_in);
+        set_solar_token(token, (long)expires_in);
+        return true;
+    }
+    const char* msg = json_stream_string(json, "msg");
+    if (msg) {
+        char log_message[CHAR_LEN];
+        snprintf(log_message, CHAR_LEN, "Solar token error: %s", msg);
+        errorPublish(log_message);
+    }
+    return false;
+}
+
+// Solarman replies carry success and msg, an expired token is cleared so the login runs again
+static bool solarman_success(const JsonStream* json) {
+    double success;
+    if (!json_stream_number(json, "success", &success)) {
+        return false;
+    }
+    if (success != 0) {
+        return true;
+    }
+    const char* msg = json_stream_string(json, "msg");
+    if (msg && strcmp(msg, "auth invalid token") == 0) {
+        logAndPublish("Solar token expired, clearing for refresh");
+        clear_solar_token();
+    } else if (msg) {
+        char log_message[CHAR_LEN];
+        snprintf(log_message, CHAR_LEN, "Solar request failed: %s", msg);
+        errorPublish(log_message);
+    }
+    return false;
+}
+
+// buyValue of the first station data item of a history reply
+static const char* const solarHistoryFields[] = {"success", "msg", "stationDataItems[0].buyValue"};
 
-            char url_buffer[URL_BUFFER_SIZE];
-            char post_buffer[POST_BUFFER_SIZE];
-            char currentDate[CHAR_LEN];
+static bool solarman_buy_value(const JsonStream* json, float* buy_value) {
+    double value;
+    if (!solarman_success(json) || !json_stream_number(json, "stationDataItems[0].buyValue", &value)) {
+        return false;
+    }
+    *buy_value = value;
+    return true;
+}
 
-            // Get current date
-            time_t now_time = time(NULL);
-            struct tm current_tm;
-            localtime_r(&now_time, &current_tm);
-            strftime(currentDate, sizeof(currentDate), "%Y-%m-%d", &current_tm);
+// Current solar values from Solarman
+static void current_solar_build(char* url, char* post, time_t now) {
+    (void)now;
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://%s/station/v1.0/realTime?language=en", SOLAR_URL);
+    snprintf(post, POST_BUFFER_SIZE,
+             "{\"stationId\":\"%s\"}", SOLAR_STATIONID);
+}
 
-            snprintf(url_buffer, URL_BUFFER_SIZE,
-                     "https://%s/station/v1.0/history?language=en", SOLAR_URL);
+static const char* const currentSolarFields[] = {
+    "success", "msg", "batterySoc", "usePower", "wirePower", "batteryPower", "lastUpdateTime", "generationPower",
+};
 
-            snprintf(post_buffer, POST_BUFFER_SIZE,
-                     "{\"stationId\":\"%s\",\"timeType\":2,\"startTime\":\"%s\",\"endTime\":\"%s\"}",
-                     SOLAR_STATIONID, currentDate, currentDate);
+static bool current_solar_parse(const JsonStream* json) {
+    if (!solarman_success(json)) {
+        return false;
+    }
 
-            struct MemoryStruct chunk;
-            CURL* curl = init_curl_request(url_buffer, &chunk);
+    double battery_soc, use_power, wire_power, battery_power, last_update, generation_power;
+    if (!json_stream_number(json, "batterySoc", &battery_soc) ||
+        !json_stream_number(json, "usePower", &use_power) ||
+        !json_stream_number(json, "wirePower", &wire_power) ||
+        !json_stream_number(json, "batteryPower", &battery_power) ||
+        !json_stream_number(json, "lastUpdateTime", &last_update) ||
+        !json_stream_number(json, "generationPower", &generation_power)) {
+        return false;
+    }
 
-            if (curl) {
-                struct curl_slist* headers = NULL;
-                headers = curl_slist_append(headers, "Content-Type: application/json");
+    float rec_batteryCharge = battery_soc;
+    float rec_usingPower = use_power;
+    float rec_gridPower = wire_power;
+    float rec_batteryPower = battery_power;
+    time_t rec_time = (time_t)last_update;
+    float rec_solarPower = generation_power;
+
+    struct tm ts;
+    char time_buf[CHAR_LEN];
+    localtime_r(&rec_time, &ts);
+    strftime(time_buf, sizeof(time_buf), "%H:%M:%S", &ts);
+
+    // Recorded first so the screen sees today's min and max with the new values
+    record_sample(TS_SERIES_SOLAR_CHARGE, rec_time, rec_batteryCharge);
+    record_sample(TS_SERIES_SOLAR_POWER, rec_time, rec_solarPower / 1000);
+    record_sample(TS_SERIES_SOLAR_GRID, rec_time, rec_gridPower / 1000);
+    record_sample(TS_SERIES_SOLAR_BATTERY, rec_time, rec_batteryPower / 1000);
+    record_sample(TS_SERIES_SOLAR_USING, rec_time, rec_usingPower / 1000);
+
+    DataWriteGuard publish;
+    solar.currentUpdateTime = time(NULL);
+    solar.solarPower = rec_solarPower / 1000;
+    solar.batteryPower = rec_batteryPower / 1000;
+    solar.usingPower = rec_usingPower / 1000;
+    solar.batteryCharge = rec_batteryCharge;
+    solar.gridPower = rec_gridPower / 1000;
+    snprintf(solar.time, CHAR_LEN, "%s", time_buf);
+    solar.generation++;
+    return true;
+}
 
-                char auth_header[SOLAR_TOKEN_LENGTH + 20];
-                snprintf(auth_header, sizeof(auth_header), "Authorization: %s", local_token);
-                headers = curl_slist_append(headers, auth_header);
-
-                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_buffer);
-
-                CURLcode res = curl_easy_perform(curl);
-
-                if (res == CURLE_OK) {
-                    long response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                    if (response_code == 200 && chunk.size > 0) {
-                        struct json_object* root = json_tokener_parse(chunk.memory);
-
-                        if (root != NULL) {
-                            struct json_object* success_obj;
-                            if (json_object_object_get_ex(root, "success", &success_obj)) {
-                                bool rec_success = json_object_get_boolean(success_obj);
-
-                                if (rec_success) {
-                                    struct json_object* station_data_items;
-                                    if (json_object_object_get_ex(root, "stationDataItems", &station_data_items)) {
-                                        struct json_object* first_item = json_object_array_get_idx(station_data_items, 0);
-                                        if (first_item) {
-                                            struct json_object* buy_value_obj;
-                                            if (json_object_object_get_ex(first_item, "buyValue", &buy_value_obj)) {
-                                                float today_buy = json_object_get_double(buy_value_obj);
-
-                                                {
-                                                    std::lock_guard<std::mutex> lock(dataMutex);
-                                                    solar.today_buy = today_buy;
-                                                    solar.dailyUpdateTime = time(NULL);
-                                                }
-
-                                                logAndPublish("Solar today's buy value updated");
-                                                saveDataBlock(SOLAR_DATA_FILENAME, &solar, sizeof(solar));
-                                            }
-                                        }
-                                    }
-                                } else {
-                                    logAndPublish("Solar today's buy value update failed: No success");
-                                }
-                            }
-                            json_object_put(root);
-                        } else {
-                            logAndPublish("Solar today's buy value update failed: JSON parse error");
-                        }
-                    } else {
-                        char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN,
-                                 "[HTTP] GET solar today buy value failed, response code: %ld", response_code);
-                        errorPublish(log_message);
-                        logAndPublish("Getting solar today buy value failed");
-                        usleep(API_FAIL_DELAY_SEC * 1000000);
-                    }
-                } else {
-                    char log_message[CHAR_LEN];
-                    snprintf(log_message, CHAR_LEN, "[HTTP] GET solar today buy value failed: %s",
-                             curl_easy_strerror(res));
-                    errorPublish(log_message);
-                    logAndPublish("Getting solar today buy value failed");
-                    usleep(API_FAIL_DELAY_SEC * 1000000);
-                }
+// Today's bought energy from the Solarman daily history
+static void daily_solar_build(char* url, char* post, time_t now) {
+    char currentDate[CHAR_LEN];
+    struct tm current_tm;
+    localtime_r(&now, &current_tm);
+    strftime(currentDate, sizeof(currentDate), "%Y-%m-%d", &current_tm);
+
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://%s/station/v1.0/history?language=en", SOLAR_URL);
+    snprintf(post, POST_BUFFER_SIZE,
+             "{\"stationId\":\"%s\",\"timeType\":2,\"startTime\":\"%s\",\"endTime\":\"%s\"}",
+             SOLAR_STATIONID, currentDate, currentDate);
+}
+
+static bool daily_solar_parse(const JsonStream* json) {
+    float today_buy;
+    if (!solarman_buy_value(json, &today_buy)) {
+        return false;
+    }
+    DataWriteGuard publish;
+    solar.today_buy = today_buy;
+    solar.dailyUpdateTime = time(NULL);
+    solar.generation++;
+    return true;
+}
+
+// This month's bought energy from the Solarman monthly history
+static void monthly_solar_build(char* url, char* post, time_t now) {
+    char currentYearMonth[CHAR_LEN];
+    struct tm current_tm;
+    localtime_r(&now, &current_tm);
+    strftime(currentYearMonth, sizeof(currentYearMonth), "%Y-%m", &current_tm);
+
+    snprintf(url, URL_BUFFER_SIZE,
+             "https://%s/station/v1.0/history?language=en", SOLAR_URL);
+    snprintf(post, POST_BUFFER_SIZE,
+             "{\"stationId\":\"%s\",\"timeType\":3,\"startTime\":\"%s\",\"endTime\":\"%s\"}",
+             SOLAR_STATIONID, currentYearMonth, currentYearMonth);
+}
+
+static bool monthly_solar_parse(const JsonStream* json) {
+    float month_buy;
+    if (!solarman_buy_value(json, &month_buy)) {
+        return false;
+    }
+    DataWriteGuard publish;
+    solar.month_buy = month_buy;
+    solar.monthlyUpdateTime = time(NULL);
+    solar.generation++;
+    return true;
+}
+
+#define API_FIELDS(fields) fields, (int)(sizeof(fields) / sizeof(fields[0]))
+
+static const ApiEndpoint apiEndpoints[] = {
+    {"Weather", API_SOURCE_WEATHER, WEATHER_UPDATE_INTERVAL_SEC, false, NULL, weather_build, API_FIELDS(weatherFields), weather_parse, STATE_SECTION_WEATHER, &weather,
+     offsetof(Weather, updateTime)},
+    {"UV", API_SOURCE_WEATHER, UV_UPDATE_INTERVAL_SEC, false, uv_ready, uv_build, API_FIELDS(uvFields), uv_parse, STATE_SECTION_UV, &uv, offsetof(UV, updateTime)},
+    {"Solar token", API_SOURCE_SOLAR, 0, false, solar_token_ready, solar_token_build, API_FIELDS(solarTokenFields), solar_token_parse, -1, NULL, 0},
+    {"Solar status", API_SOURCE_SOLAR, SOLAR_CURRENT_UPDATE_INTERVAL_SEC, true, NULL, current_solar_build, API_FIELDS(currentSolarFields), current_solar_parse, STATE_SECTION_SOLAR,
+     &solar, offsetof(Solar, currentUpdateTime)},
+    {"Solar today's buy value", API_SOURCE_SOLAR, SOLAR_DAILY_UPDATE_INTERVAL_SEC, true, NULL, daily_solar_build, API_FIELDS(solarHistoryFields), daily_solar_parse,
+     STATE_SECTION_SOLAR, &solar, offsetof(Solar, dailyUpdateTime)},
+    {"Solar month's buy value", API_SOURCE_SOLAR, SOLAR_MONTHLY_UPDATE_INTERVAL_SEC, true, NULL, monthly_solar_build, API_FIELDS(solarHistoryFields), monthly_solar_parse,
+     STATE_SECTION_SOLAR, &solar, offsetof(Solar, monthlyUpdateTime)},
+};
+static const int API_ENDPOINT_COUNT = sizeof(apiEndpoints) / sizeof(apiEndpoints[0]);
+static ApiRequest apiRequests[API_ENDPOINT_COUNT];
+
+static time_t api_last_update(const ApiEndpoint* endpoint) {
+    time_t last_update;
+    std::lock_guard<std::mutex> lock(dataMutex);
+    memcpy(&last_update, (const uint8_t*)endpoint->state + endpoint->updateTimeOffset, sizeof(last_update));
+    return last_update;
+}
 
-                free(chunk.memory);
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
+// Set up the endpoint's request if one is due, otherwise push nextDue back
+static bool api_poll(const ApiEndpoint* endpoint, ApiRequest* request, time_t now) {
+    if (endpoint->ready && !endpoint->ready(now)) {
+        return false;
+    }
+    if (endpoint->state) {
+        time_t last_update = api_last_update(endpoint);
+        if (now - last_update <= endpoint->intervalSec) {
+            // Checked again sooner if ready can change its mind, night can start before the UV is due
+            if (!endpoint->ready) {
+                request->nextDue = last_update + endpoint->intervalSec + 1;
             }
+            return false;
         }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
     }
-    return NULL;
+    char token[SOLAR_TOKEN_LENGTH];
+    if (endpoint->needsToken && !get_solar_token_copy(token, sizeof(token))) {
+        // Woken by api_done() when a token arrives, the wait is only a fallback
+        request->waitingForToken = true;
+        request->nextDue = now + SOLAR_TOKEN_WAIT_SEC;
+        return false;
+    }
+
+    char url[URL_BUFFER_SIZE];
+    request->post[0] = '\0';
+    endpoint->build(url, request->post, now);
+
+    // The endpoint's handle, reset for this request
+    CURL* curl = http_handle(request->curl);
+    if (!curl) {
+        return false;
+    }
+    request->curl = curl;
+    json_stream_init(&request->json, endpoint->fields, endpoint->fieldCount, &request->text);
+    request->received = 0;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, json_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)request);
+
+    if (request->post[0]) {
+        if (!endpoint->needsToken) {
+            token[0] = '\0';
+        }
+        if (!request->headers || strcmp(token, request->headerToken) != 0) {
+            curl_slist_free_all(request->headers);
+            request->headers = curl_slist_append(NULL, "Content-Type: application/json");
+            if (endpoint->needsToken) {
+                char auth_header[SOLAR_TOKEN_LENGTH + 20];
+                snprintf(auth_header, sizeof(auth_header), "Authorization: %s", token);
+                request->headers = curl_slist_append(request->headers, auth_header);
+            }
+            snprintf(request->headerToken, sizeof(request->headerToken), "%s", token);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->post);
+    }
+    return true;
 }
 
-// Get monthly solar values from Solarman
-void* get_monthly_solar_t(void* pvParameters) {
-    (void)pvParameters;
+// Seconds before the next try after failures in a row. The delay doubles from API_FAIL_DELAY_SEC up to
+// API_BACKOFF_MAX_SEC, once the circuit is open only a probe is sent every API_BREAKER_OPEN_SEC. Half
+// of it is random so endpoints that failed together do not all retry together.
+static int api_retry_delay(int failures) {
+    static unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)getpid();
+    int delay = API_FAIL_DELAY_SEC;
+    if (failures >= API_BREAKER_FAILURES) {
+        delay = API_BREAKER_OPEN_SEC;
+    } else {
+        for (int i = 1; i < failures && delay < API_BACKOFF_MAX_SEC; i++) {
+            delay *= 2;
+        }
+        delay = std::min(delay, API_BACKOFF_MAX_SEC);
+    }
+    return delay / 2 + rand_r(&seed) % (delay / 2 + 1);
+}
 
-    while (true) {
-        time_t last_update;
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            last_update = solar.monthlyUpdateTime;
+// Worst state of the endpoints behind a status indicator. Stale data is down, while the data is
+// fresh an open breaker only degrades it, the values shown are still good
+int api_status(int source, bool fresh) {
+    if (!fresh) {
+        return STATUS_DOWN;
+    }
+    int status = STATUS_OK;
+    for (int i = 0; i < API_ENDPOINT_COUNT; i++) {
+        if (apiEndpoints[i].source != source) {
+            continue;
         }
+        int endpoint_status = apiRequests[i].status.load(std::memory_order_relaxed);
+        if (endpoint_status != STATUS_OK) {
+            status = STATUS_DEGRADED;
+        }
+    }
+    return status;
+}
 
-        if (time(NULL) - last_update > SOLAR_MONTHLY_UPDATE_INTERVAL_SEC) {
-            char local_token[SOLAR_TOKEN_LENGTH];
-            if (!get_solar_token_copy(local_token, sizeof(local_token))) {
-                usleep(SOLAR_TOKEN_WAIT_SEC * 1000000);
-                continue;
+// Check the response and hand it to the endpoint's parser. A failure backs the endpoint off, see api_retry_delay(),
+// and a server's Retry-After is honoured when it asks for longer.
+static void api_done(void* owner, CURLcode res, long response_code) {
+    ApiRequest* request = (ApiRequest*)owner;
+    const ApiEndpoint* endpoint = &apiEndpoints[request - apiRequests];
+    request->inFlight = false;
+    http_count_decoded(request->received);
+
+    char log_message[CHAR_LEN];
+    bool updated = false;
+    if (res != CURLE_OK) {
+        snprintf(log_message, CHAR_LEN, "[HTTP] %s request failed: %s", endpoint->name, curl_easy_strerror(res));
+        errorPublish(log_message);
+    } else if (response_code != 200 || request->received == 0) {
+        snprintf(log_message, CHAR_LEN, "[HTTP] %s request failed, response code: %ld", endpoint->name, response_code);
+        errorPublish(log_message);
+    } else if (json_stream_finish(&request->json)) {
+        updated = endpoint->parse(&request->json);
+    } else {
+        snprintf(log_message, CHAR_LEN, "%s update failed: JSON parse error", endpoint->name);
+        logAndPublish(log_message);
+    }
+    if (updated) {
+        if (request->failures >= API_BREAKER_FAILURES) {
+            snprintf(log_message, CHAR_LEN, "%s is back after %d failed updates", endpoint->name, request->failures);
+            logAndPublish(log_message);
+        }
+        request->failures = 0;
+        request->status = STATUS_OK;
+        wakeDisplay();
+        snprintf(log_message, CHAR_LEN, "%s updated", endpoint->name);
+        logAndPublish(log_message);
+        if (endpoint->section >= 0) {
+            markDataDirty(endpoint->section);
+        }
+        // The requests held back for a token can go on this pass of the scheduler
+        if (has_solar_token()) {
+            for (int i = 0; i < API_ENDPOINT_COUNT; i++) {
+                if (apiRequests[i].waitingForToken) {
+                    apiRequests[i].waitingForToken = false;
+                    apiRequests[i].nextDue = 0;
+                }
             }
+        }
+        return;
+    }
 
-            char url_buffer[URL_BUFFER_SIZE];
-            char post_buffer[POST_BUFFER_SIZE];
-            char currentYearMonth[CHAR_LEN];
-
-            // Get current year-month
-            time_t now_time = time(NULL);
-            struct tm current_tm;
-            localtime_r(&now_time, &current_tm);
-            strftime(currentYearMonth, sizeof(currentYearMonth), "%Y-%m", &current_tm);
+    request->failures++;
+    int delay = api_retry_delay(request->failures);
+    curl_off_t retry_after = 0;
+    if (res == CURLE_OK && curl_easy_getinfo(request->curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK && retry_after > delay) {
+        delay = (int)std::min(retry_after, (curl_off_t)API_RETRY_AFTER_MAX_SEC);
+    }
+    request->nextDue = time(NULL) + delay;
 
-            snprintf(url_buffer, URL_BUFFER_SIZE,
-                     "https://%s/station/v1.0/history?language=en", SOLAR_URL);
+    if (request->failures < API_BREAKER_FAILURES) {
+        request->status = STATUS_DEGRADED;
+        snprintf(log_message, CHAR_LEN, "%s update failed, retry in %ds", endpoint->name, delay);
+        logAndPublish(log_message);
+    } else {
+        // Open, the retry is a single probe request that closes it again if it works
+        request->status = STATUS_DOWN;
+        if (request->failures == API_BREAKER_FAILURES) {
+            snprintf(log_message, CHAR_LEN, "%s down after %d failed updates, probing every %ds", endpoint->name, request->failures, API_BREAKER_OPEN_SEC);
+            errorPublish(log_message);
+        } else {
+            snprintf(log_message, CHAR_LEN, "%s probe failed, next in %ds", endpoint->name, delay);
+            logAndPublish(log_message);
+        }
+    }
+}
 
-            snprintf(post_buffer, POST_BUFFER_SIZE,
-                     "{\"stationId\":\"%s\",\"timeType\":3,\"startTime\":\"%s\",\"endTime\":\"%s\"}",
-                     SOLAR_STATIONID, currentYearMonth, currentYearMonth);
+// Single thread behind every API call. Each endpoint is polled when its due time passes, the
+// requests run concurrently on the shared multi handle, and the thread sleeps in curl until the
+// earliest due time or until a transfer needs attention.
+void* api_scheduler_t(void* pvParameters) {
+    (void)pvParameters;
 
-            struct MemoryStruct chunk;
-            CURL* curl = init_curl_request(url_buffer, &chunk);
+    for (int i = 0; i < API_ENDPOINT_COUNT; i++) {
+        apiRequests[i].status = STATUS_OK;
+    }
+    load_solar_token();
 
-            if (curl) {
-                struct curl_slist* headers = NULL;
-                headers = curl_slist_append(headers, "Content-Type: application/json");
+    while (true) {
+        time_t now = time(NULL);
+        time_t next_due = now + API_IDLE_SEC;
 
-                char auth_header[SOLAR_TOKEN_LENGTH + 20];
-                snprintf(auth_header, sizeof(auth_header), "Authorization: %s", local_token);
-                headers = curl_slist_append(headers, auth_header);
-
-                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_buffer);
-
-                CURLcode res = curl_easy_perform(curl);
-
-                if (res == CURLE_OK) {
-                    long response_code;
-                    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-                    if (response_code == 200 && chunk.size > 0) {
-                        struct json_object* root = json_tokener_parse(chunk.memory);
-
-                        if (root != NULL) {
-                            struct json_object* success_obj;
-                            if (json_object_object_get_ex(root, "success", &success_obj)) {
-                                bool rec_success = json_object_get_boolean(success_obj);
-
-                                if (rec_success) {
-                                    struct json_object* station_data_items;
-                                    if (json_object_object_get_ex(root, "stationDataItems", &station_data_items)) {
-                                        struct json_object* first_item = json_object_array_get_idx(station_data_items, 0);
-                                        if (first_item) {
-                                            struct json_object* buy_value_obj;
-                                            if (json_object_object_get_ex(first_item, "buyValue", &buy_value_obj)) {
-                                                float month_buy = json_object_get_double(buy_value_obj);
-
-                                                {
-                                                    std::lock_guard<std::mutex> lock(dataMutex);
-                                                    solar.month_buy = month_buy;
-                                                    solar.monthlyUpdateTime = time(NULL);
-                                                }
-
-                                                logAndPublish("Solar month's buy value updated");
-                                                saveDataBlock(SOLAR_DATA_FILENAME, &solar, sizeof(solar));
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                            json_object_put(root);
-                        } else {
-                            logAndPublish("Solar month's buy value update failed: JSON parse error");
-                        }
+        for (int i = 0; i < API_ENDPOINT_COUNT; i++) {
+            const ApiEndpoint* endpoint = &apiEndpoints[i];
+            ApiRequest* request = &apiRequests[i];
+            if (request->inFlight) {
+                continue;
+            }
+            if (request->nextDue <= now) {
+                // Same cadence as before if the poll or its response does not pick another
+                request->nextDue = now + API_IDLE_SEC;
+                if (api_poll(endpoint, request, now)) {
+                    if (http_start(request->curl, request)) {
+                        request->inFlight = true;
                     } else {
                         char log_message[CHAR_LEN];
-                        snprintf(log_message, CHAR_LEN,
-                                 "[HTTP] GET solar month buy value failed, response code: %ld", response_code);
+                        snprintf(log_message, CHAR_LEN, "[HTTP] Failed to start %s request", endpoint->name);
                         errorPublish(log_message);
-                        logAndPublish("Getting solar month buy value failed");
-                        usleep(API_FAIL_DELAY_SEC * 1000000);
                     }
-                } else {
-                    char log_message[CHAR_LEN];
-                    snprintf(log_message, CHAR_LEN, "[HTTP] GET solar month buy value failed: %s",
-                             curl_easy_strerror(res));
-                    errorPublish(log_message);
-                    logAndPublish("Getting solar month buy value failed");
-                    usleep(API_FAIL_DELAY_SEC * 1000000);
                 }
-
-                free(chunk.memory);
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
+            }
+            if (!request->inFlight && request->nextDue < next_due) {
+                next_due = request->nextDue;
             }
         }
-        usleep(API_LOOP_DELAY_SEC * 1000000);
+
+        http_run((int)(next_due - now) * 1000, api_done);
     }
     return NULL;
-}
\ No newline at end of file
+}
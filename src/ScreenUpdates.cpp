@@ -1,7 +1,6 @@
 
 #include "globals.h"
 
-extern Readings readings[];
 extern Weather weather;
 extern Solar solar;
 
@@ -101,7 +100,12 @@ void set_solar_values(const Solar* solar) {
         }
 
         // Define and set value for min and max solar
-        snprintf(tempString, CHAR_LEN, "Min %2.0f\nMax %2.0f", solar->today_battery_min, solar->today_battery_max);
+        RollupStats batteryToday;
+        if (rollup_get(TS_SERIES_SOLAR_CHARGE, ROLLUP_DAY, time(NULL), &batteryToday)) {
+            snprintf(tempString, CHAR_LEN, "Min %2.0f\nMax %2.0f", batteryToday.min, batteryToday.max);
+        } else {
+            snprintf(tempString, CHAR_LEN, "Min --\nMax --");
+        }
         lv_label_set_text(ui_SolarMinMax, tempString);
         // Set solar update times
         struct tm ts;
@@ -125,6 +129,61 @@ void set_solar_values(const Solar* solar) {
     }
 }
 
+// Set weather values in GUI
+void set_weather_values(const Weather* weather) {
+    char tempString[CHAR_LEN];
+    if (weather->updateTime > 0) {
+        lv_label_set_text(ui_FCConditions, weather->description);
+        snprintf(tempString, CHAR_LEN, "Updated %.238s", weather->time_string);
+        lv_label_set_text(ui_FCUpdateTime, tempString);
+        char windString[CHAR_LEN + 20];
+        snprintf(windString, sizeof(windString), "Wind %2.0f km/h %s", weather->windSpeed, weather->windDir);
+        lv_label_set_text(ui_FCWindSpeed, windString);
+
+        lv_arc_set_value(ui_TempArcFC, weather->temperature);
+
+        snprintf(tempString, CHAR_LEN, "%2.0f", weather->temperature);
+        lv_label_set_text(ui_TempLabelFC, tempString);
+
+        snprintf(tempString, CHAR_LEN, "%2.0f°C", weather->minTemp);
+        lv_label_set_text(ui_FCMin, tempString);
+        snprintf(tempString, CHAR_LEN, "%2.0f°C", weather->maxTemp);
+        lv_label_set_text(ui_FCMax, tempString);
+        lv_obj_clear_flag(ui_TempArcFC, LV_OBJ_FLAG_HIDDEN);
+        lv_arc_set_range(ui_TempArcFC, weather->minTemp, weather->maxTemp);
+    }
+}
+
+// Set UV values in GUI, update time is only shown during the day
+void set_uv_values(const UV* uv, bool isDay) {
+    char tempString[CHAR_LEN];
+    if (uv->updateTime > 0) {
+        lv_obj_clear_flag(ui_UVArc, LV_OBJ_FLAG_HIDDEN);
+        if (isDay) {
+            snprintf(tempString, sizeof(tempString), "Updated %.238s", uv->time_string);
+        } else {
+            tempString[0] = '\0';
+        }
+        lv_label_set_text(ui_UVUpdateTime, tempString);
+        snprintf(tempString, CHAR_LEN, "%i", uv->index);
+        lv_label_set_text(ui_UVLabel, tempString);
+        lv_arc_set_value(ui_UVArc, uv->index * 10);
+
+        lv_obj_set_style_arc_color(ui_UVArc, lv_color_hex(uv_color(uv->index)), LV_PART_INDICATOR | LV_STATE_DEFAULT);
+        lv_obj_set_style_bg_color(ui_UVArc, lv_color_hex(uv_color(uv->index)), LV_PART_KNOB | LV_STATE_DEFAULT);
+    }
+}
+
+// Set a status indicator green, yellow when degraded or red when down, the widget is only touched when the state changes
+void set_status_indicator(lv_obj_t* indicator, int state, int* shownState) {
+    if (*shownState == state) {
+        return;
+    }
+    *shownState = state;
+    int color = state == STATUS_OK ? COLOR_GREEN : state == STATUS_DEGRADED ? COLOR_YELLOW : COLOR_RED;
+    lv_obj_set_style_text_color(indicator, lv_color_hex(color), LV_PART_MAIN);
+}
+
 // Sets UV color based on value
 int uv_color(float UV) {
     if (UV < 1) {
@@ -163,53 +222,56 @@ int uv_color(float UV) {
     return 0x4B1E88;
 }
 
-// Sets all text field to defined color for day/night mode
-void set_basic_text_color(lv_color_t color) {
-    lv_obj_set_style_text_color(ui_TempLabelFC, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_UVLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_UsingLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_SolarLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_BatteryLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_RoomName1, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_RoomName2, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_RoomName3, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_RoomName4, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_RoomName5, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TempLabel1, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TempLabel2, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TempLabel3, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TempLabel4, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TempLabel5, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_HumidLabel1, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_HumidLabel2, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_HumidLabel3, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_HumidLabel4, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_HumidLabel5, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_StatusMessage, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Time, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextRooms, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextForecastName, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextBattery, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextSolar, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextUsing, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextUV, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_FCConditions, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_FCWindSpeed, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_FCUpdateTime, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_UVUpdateTime, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_ChargingLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_AsofTimeLabel, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_ChargingTime, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_TextKlaussometer, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_SolarMinMax, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_GridBought, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_FCMin, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_FCMax, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Direction1, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Direction2, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Direction3, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Direction4, color, LV_PART_MAIN);
-    lv_obj_set_style_text_color(ui_Direction5, color, LV_PART_MAIN);
+// Day/night theme. All basic text, the screen background and the container borders share these
+// styles, so switching mode is one change per style rather than a call per widget.
+static lv_style_t themeTextStyle;
+static lv_style_t themeScreenStyle;
+static lv_style_t themeBorderStyle;
+static int themeShown = -1;
+
+static lv_obj_t** const themedLabels[] = {
+    &ui_TempLabelFC, &ui_UVLabel, &ui_UsingLabel, &ui_SolarLabel, &ui_BatteryLabel, &ui_RoomName1, &ui_RoomName2, &ui_RoomName3, &ui_RoomName4, &ui_RoomName5,
+    &ui_TempLabel1, &ui_TempLabel2, &ui_TempLabel3, &ui_TempLabel4, &ui_TempLabel5, &ui_HumidLabel1, &ui_HumidLabel2, &ui_HumidLabel3, &ui_HumidLabel4, &ui_HumidLabel5,
+    &ui_StatusMessage, &ui_Time, &ui_TextRooms, &ui_TextForecastName, &ui_TextBattery, &ui_TextSolar, &ui_TextUsing, &ui_TextUV, &ui_FCConditions, &ui_FCWindSpeed,
+    &ui_FCUpdateTime, &ui_UVUpdateTime, &ui_ChargingLabel, &ui_AsofTimeLabel, &ui_ChargingTime, &ui_TextKlaussometer, &ui_SolarMinMax, &ui_GridBought, &ui_FCMin,
+    &ui_FCMax, &ui_Direction1, &ui_Direction2, &ui_Direction3, &ui_Direction4, &ui_Direction5
+};
+
+// Attach the shared theme styles, dropping the local colours SquareLine set so the styles take effect
+void theme_init() {
+    lv_style_init(&themeTextStyle);
+    lv_style_init(&themeScreenStyle);
+    lv_style_init(&themeBorderStyle);
+
+    for (size_t i = 0; i < sizeof(themedLabels) / sizeof(themedLabels[0]); i++) {
+        lv_obj_add_style(*themedLabels[i], &themeTextStyle, LV_PART_MAIN);
+    }
+
+    lv_obj_remove_local_style_prop(lv_scr_act(), LV_STYLE_BG_COLOR, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_add_style(lv_scr_act(), &themeScreenStyle, LV_PART_MAIN);
+    lv_obj_remove_local_style_prop(ui_Container1, LV_STYLE_BORDER_COLOR, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_add_style(ui_Container1, &themeBorderStyle, LV_PART_MAIN);
+    lv_obj_remove_local_style_prop(ui_Container2, LV_STYLE_BORDER_COLOR, LV_PART_MAIN | LV_STATE_DEFAULT);
+    lv_obj_add_style(ui_Container2, &themeBorderStyle, LV_PART_MAIN);
+}
+
+// Switch between day and night colours, nothing is touched unless the mode changes
+void set_theme(bool isDay) {
+    int mode = isDay ? 1 : 0;
+    if (mode == themeShown) {
+        return;
+    }
+    themeShown = mode;
+
+    lv_color_t foreground = lv_color_hex(isDay ? COLOR_BLACK : COLOR_WHITE);
+    lv_color_t background = lv_color_hex(isDay ? COLOR_WHITE : COLOR_BLACK);
+    lv_style_set_text_color(&themeTextStyle, foreground);
+    lv_style_set_border_color(&themeBorderStyle, foreground);
+    lv_style_set_bg_color(&themeScreenStyle, background);
+
+    lv_obj_report_style_change(&themeTextStyle);
+    lv_obj_report_style_change(&themeBorderStyle);
+    lv_obj_report_style_change(&themeScreenStyle);
 }
 
 void format_integer_with_commas(long long num, char* out, size_t outSize) {
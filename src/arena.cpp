@@ -0,0 +1,77 @@
+#include "globals.h"
+
+// A block that is reused from one request to the next. It grows to the largest size it is asked
+// for and then stays there, so once the responses have been seen nothing more is allocated.
+// arena_alloc() only bumps within the block and never allocates, callers reserve first.
+
+// Counters over every arena, reported by arena_report_stats(). A steady state shows no allocations.
+static std::mutex arenaStatsMutex;
+static uint64_t arenaResets = 0;
+static uint64_t arenaAllocations = 0;
+static size_t arenaHeld = 0;
+static size_t arenaHighWater = 0;
+
+// Make room for size bytes, keeping what is already there, false if that is more than ARENA_MAX_SIZE or memory ran out
+bool arena_reserve(Arena* arena, size_t size) {
+    if (size <= arena->size) {
+        return true;
+    }
+    if (size > ARENA_MAX_SIZE) {
+        return false;
+    }
+    size_t new_size = arena->size ? arena->size * 2 : ARENA_MIN_SIZE;
+    while (new_size < size) {
+        new_size *= 2;
+    }
+    if (new_size > ARENA_MAX_SIZE) {
+        new_size = ARENA_MAX_SIZE;
+    }
+    char* base = (char*)realloc(arena->base, new_size);
+    if (!base) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(arenaStatsMutex);
+        arenaAllocations++;
+        arenaHeld += new_size - arena->size;
+    }
+    arena->base = base;
+    arena->size = new_size;
+    return true;
+}
+
+// Next size bytes of the block, NULL if they do not fit
+char* arena_alloc(Arena* arena, size_t size) {
+    if (size > arena->size - arena->used) {
+        return NULL;
+    }
+    char* block = arena->base + arena->used;
+    arena->used += size;
+    return block;
+}
+
+void arena_reset(Arena* arena) {
+    {
+        std::lock_guard<std::mutex> lock(arenaStatsMutex);
+        arenaResets++;
+        if (arena->used > arenaHighWater) {
+            arenaHighWater = arena->used;
+        }
+    }
+    arena->used = 0;
+}
+
+void arena_report_stats() {
+    char stats_message[CHAR_LEN];
+    {
+        std::lock_guard<std::mutex> lock(arenaStatsMutex);
+        if (arenaResets == 0) {
+            return;
+        }
+        snprintf(stats_message, CHAR_LEN, "Arena %llu resets, %llu allocations, %.1f KB held, most used %zu bytes", (unsigned long long)arenaResets,
+                 (unsigned long long)arenaAllocations, arenaHeld / 1024.0, arenaHighWater);
+        arenaResets = 0;
+        arenaAllocations = 0;
+    }
+    statsPublish(stats_message);
+}
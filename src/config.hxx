@@ -13,6 +13,7 @@ static const int MQTT_PORT = 1883;                 // port
 
 static const char* WEATHERBIT_API = "xxx"; // API key
 static const char* WEATHERBIT_CITY_ID = "xxx";                      // City ID for Cape Town
+static const bool UV_WEATHERBIT_FALLBACK = true; // Get the UV from Weatherbit when Open-Meteo has not sent it for an hour
 static const char* LATITUDE = "xxx";
 static const char* LONGITUDE = "xxx";
 
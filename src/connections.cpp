@@ -2,7 +2,6 @@
 #include <mosquitto.h>
 
 extern struct mosquitto* mosq;
-extern Readings readings[];
 extern int numberOfReadings;
 extern struct tm timeinfo;
 extern bool mqtt_connected;
@@ -12,11 +11,17 @@ void on_connect_callback(struct mosquitto* mosq, void* obj, int rc) {
     (void)obj;
     if (rc == 0) {
         mqtt_connected = true;
+        wakeDisplay();
         logAndPublish("Connected to the MQTT broker");
 
-        // Subscribe to all topics
-        for (int i = 0; i < numberOfReadings; i++) {
-            mosquitto_subscribe(mosq, NULL, readings[i].topic, 0);
+        // Subscribe to the wildcard patterns and any sensor topic they don't cover, in one request
+        const char* filters[MAX_READINGS + MAX_TOPIC_PATTERNS];
+        int filterCount = topic_subscriptions(filters, sizeof(filters) / sizeof(filters[0]));
+        int subscribe_rc = mosquitto_subscribe_multiple(mosq, NULL, filterCount, (char* const*)filters, 0, 0, NULL);
+        if (subscribe_rc != MOSQ_ERR_SUCCESS) {
+            char log_msg[CHAR_LEN];
+            snprintf(log_msg, CHAR_LEN, "MQTT subscribe failed: %s", mosquitto_strerror(subscribe_rc));
+            logAndPublish(log_msg);
         }
     } else {
         mqtt_connected = false;
@@ -31,6 +36,7 @@ void on_disconnect_callback(struct mosquitto* mosq, void* obj, int rc) {
     (void)obj;
     (void)mosq;
     mqtt_connected = false;
+    wakeDisplay();
     if (rc != 0) {
         logAndPublish("MQTT connection lost unexpectedly");
     }
@@ -40,8 +46,8 @@ void on_disconnect_callback(struct mosquitto* mosq, void* obj, int rc) {
 void on_message_callback(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg) {
     (void)mosq;
     (void)obj;
-    // This will be handled in mqtt.cpp - just forward to processing function
-    process_mqtt_message(msg->topic, (char*)msg->payload, msg->payloadlen);
+    // Handled by the ingest worker in mqtt.cpp, just queue it so the network loop never waits
+    mqtt_enqueue_message(msg->topic, (const char*)msg->payload, msg->payloadlen);
 }
 
 void mqtt_connect() {
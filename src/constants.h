@@ -1,23 +1,36 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
-#define STORED_READING 6
-#define READINGS_ARRAY                                                                                                             \
-    {"Cave", "cave/tempset-ambient/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_TEMPERATURE, 0, 0},                  \
-        {"Living room", "livingroom/tempset-ambient/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_TEMPERATURE, 0, 0}, \
-        {"Playroom", "guest/tempset-ambient/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_TEMPERATURE, 0, 0},         \
-        {"Bedroom", "bedroom/tempset-ambient/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_TEMPERATURE, 0, 0},        \
-        {"Outside", "outside/tempset-ambient/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_TEMPERATURE, 0, 0},        \
-        {"Cave", "cave/tempset-humidity/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_HUMIDITY, 0, 0},                \
-        {"Living room", "livingroom/tempset-humidity/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_HUMIDITY, 0, 0},   \
-        {"Playroom", "guest/tempset-humidity/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_HUMIDITY, 0, 0},           \
-        {"Bedroom", "bedroom/tempset-humidity/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_HUMIDITY, 0, 0},          \
-        {"Outside", "outside/tempset-humidity/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_HUMIDITY, 0, 0},          \
-        {"Cave", "cave/battery/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_BATTERY, 0, 0},                          \
-        {"Living room", "livingroom/battery/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_BATTERY, 0, 0},             \
-        {"Playroom", "guest/battery/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_BATTERY, 0, 0},                     \
-        {"Bedroom", "bedroom/battery/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_BATTERY, 0, 0}, {                  \
-        "Outside", "outside/battery/set", NO_READING, 0.0, {0.0}, CHAR_NO_MESSAGE, false, DATA_BATTERY, 0, 0                       \
+#ifndef STORED_READING
+#define STORED_READING 6 // Samples in each sensor's trend window, bench/history_bench is built at other depths
+#endif
+#define MAX_READINGS 256 // Capacity of the sensor table
+#define READING_OUTPUT_LEN 10
+#define MAX_TOPIC_PATTERNS 8
+#define READINGS_ARRAY                                                       \
+    {"Cave", "cave/tempset-ambient/set", DATA_TEMPERATURE},                  \
+        {"Living room", "livingroom/tempset-ambient/set", DATA_TEMPERATURE}, \
+        {"Playroom", "guest/tempset-ambient/set", DATA_TEMPERATURE},         \
+        {"Bedroom", "bedroom/tempset-ambient/set", DATA_TEMPERATURE},        \
+        {"Outside", "outside/tempset-ambient/set", DATA_TEMPERATURE},        \
+        {"Cave", "cave/tempset-humidity/set", DATA_HUMIDITY},                \
+        {"Living room", "livingroom/tempset-humidity/set", DATA_HUMIDITY},   \
+        {"Playroom", "guest/tempset-humidity/set", DATA_HUMIDITY},           \
+        {"Bedroom", "bedroom/tempset-humidity/set", DATA_HUMIDITY},          \
+        {"Outside", "outside/tempset-humidity/set", DATA_HUMIDITY},          \
+        {"Cave", "cave/battery/set", DATA_BATTERY},                          \
+        {"Living room", "livingroom/battery/set", DATA_BATTERY},             \
+        {"Playroom", "guest/battery/set", DATA_BATTERY},                     \
+        {"Bedroom", "bedroom/battery/set", DATA_BATTERY}, {                  \
+        "Outside", "outside/battery/set", DATA_BATTERY                       \
+    }
+
+// MQTT wildcard filters subscribed in place of individual topics, the + segment names the room.
+// Topics they match that are not in READINGS_ARRAY become new sensors automatically.
+#define TOPIC_PATTERNS                              \
+    {"+/tempset-ambient/set", DATA_TEMPERATURE},    \
+        {"+/tempset-humidity/set", DATA_HUMIDITY}, { \
+        "+/battery/set", DATA_BATTERY               \
     }
 
 #define ROOM_NAME_LABELS \
@@ -62,17 +75,34 @@ static const int DATA_BATTERY = 4;
 static const int MAX_NO_MESSAGE_SEC = 1800;               // Time before CHAR_NO_MESSAGE is set in seconds (long)
 static const int TIME_RETRIES = 100;                      // Number of time to retry getting the time during setup
 static const int WEATHER_UPDATE_INTERVAL_SEC = 300;       // Interval between weather updates
-static const int UV_UPDATE_INTERVAL_SEC = 3600;           // Interval between UV updates
+static const int UV_UPDATE_INTERVAL_SEC = 3600;           // Age of the UV before the Weatherbit fallback is used
 static const int SOLAR_CURRENT_UPDATE_INTERVAL_SEC = 60;  // Interval between solar updates
 static const int SOLAR_MONTHLY_UPDATE_INTERVAL_SEC = 300; // Interval between solar current updates
 static const int SOLAR_DAILY_UPDATE_INTERVAL_SEC = 300;   // Interval between solar daily updates
 static const int SOLAR_TOKEN_WAIT_SEC = 10;               // Time to wait for solar token to be available
-static const int API_SEMAPHORE_WAIT_SEC = 10;             // Time to wait for http semaphore
-static const int API_FAIL_DELAY_SEC = 30;                 // Delay is API call fails
-static const int API_LOOP_DELAY_SEC = 10;                 // Time delay at end of API loops
+static const int SOLAR_TOKEN_REFRESH_SEC = 86400;         // Log in again this long before the solar token expires
+static const int API_FAIL_DELAY_SEC = 30;                 // Delay after the first failed API call, doubled for each failure after
+static const int API_BACKOFF_MAX_SEC = 960;               // Longest delay between retries of a failing API
+static const int API_BREAKER_FAILURES = 5;                // Failures in a row that open an API's circuit breaker
+static const int API_BREAKER_OPEN_SEC = 1800;             // Time between probes while a circuit breaker is open
+static const int API_RETRY_AFTER_MAX_SEC = 3600;          // Longest Retry-After from a server that is honoured
+static const int API_IDLE_SEC = 10;                       // Longest scheduler wait, and when an endpoint that was not polled is checked again
 static const int STATUS_MESSAGE_TIME = 1;                 // Seconds an status message can be displayed
 static const int MAX_SOLAR_TIME_STATUS_HOURS = 24;        // Max time in hours for charge / discharge that a message will be displayed for
 static const int CHECK_UPDATE_INTERVAL_SEC = 300;         // Interval between checking for OTA updates
+static const int STATS_REPORT_INTERVAL_SEC = 3600;        // Interval between printing performance counters
+#ifndef UI_FIXED_CADENCE_MS
+#define UI_FIXED_CADENCE_MS 0 // Non-zero polls the UI at this fixed cadence instead of waiting for wakeups, bench/latency_bench is built both ways
+#endif
+
+// Status indicator states, the screen starts out showing STATUS_DOWN
+static const int STATUS_DOWN = 0;
+static const int STATUS_OK = 1;
+static const int STATUS_DEGRADED = 2;
+
+// Data sources with a status indicator
+static const int API_SOURCE_WEATHER = 0;
+static const int API_SOURCE_SOLAR = 1;
 
 static const int COLOR_RED = 0xFA0000;
 static const int COLOR_YELLOW = 0xF7EA48;
@@ -85,11 +115,78 @@ static const int COLOR_BLUE = 0x2095F6;
 #define WEATHER_DATA_FILENAME "weather_data.bin"
 #define UV_DATA_FILENAME "uv_data.bin"
 #define READINGS_DATA_FILENAME "readings_data.bin"
+#define SENSORS_DATA_FILENAME "sensors_data.bin"
+#define SOLAR_TOKEN_FILENAME "solar_token.bin"
+#define DATA_FILE_MAGIC 0x3143524Bu // "KRC1", data file header with a CRC32C
+#define PERSIST_MAX_LATENCY_SEC 30 // Longest a changed block waits before it is written
+
+// Sections of the memory mapped state file, the filenames above are only read to import old state
+#define WAL_FILENAME "readings.wal"
+#define WAL_COMPACT_RECORDS 4096        // Snapshot the readings once the log holds this many records
+#define WAL_COMPACT_INTERVAL_SEC 86400 // or once it is this old
+#define WAL_SYNC_INTERVAL_SEC 10        // Appends are synced together at most this long after the first, a power cut can lose that much
+#define WAL_REPLAY_BATCH 256
+#define TS_FILENAME "history.ts"
+#define TS_FILE_MAGIC 0x5354534Bu  // "KSTS"
+#define TS_BLOCK_MAGIC 0x4B4C4254u // "TBLK"
+#define TS_VERSION 1
+#define TS_BLOCK_SIZE 4096
+#define TS_BLOCK_COUNT 2048 // 8 MB of history, the oldest blocks are reused once it is full
+// History series, solar first so their ids do not move if MAX_READINGS changes
+#define TS_SERIES_SOLAR_CHARGE 0
+#define TS_SERIES_SOLAR_POWER 1
+#define TS_SERIES_SOLAR_GRID 2
+#define TS_SERIES_SOLAR_BATTERY 3
+#define TS_SERIES_SOLAR_USING 4
+#define TS_SERIES_READING(slot) (8 + (slot))
+#define TS_MAX_SERIES TS_SERIES_READING(MAX_READINGS)
+
+// Rollup resolutions and how many periods of each are kept
+#define ROLLUP_MINUTE 0
+#define ROLLUP_HOUR 1
+#define ROLLUP_DAY 2
+#define ROLLUP_RESOLUTIONS 3
+#define ROLLUP_MINUTE_BUCKETS 60
+#define ROLLUP_HOUR_BUCKETS 48
+#define ROLLUP_DAY_BUCKETS 31
+#define STATE_FILENAME "state.bin"
+#define STATE_FILE_MAGIC 0x5453534Bu // "KSST"
+#define STATE_VERSION 3 // Bump only when the header or section framing changes, struct changes are migrated
+#define STATE_VERSION_SHARED_HEADER_PAGE 2 // Both header copies in page 0, still read so its state is migrated
+#define STATE_MAX_SECTIONS 16
+#define STATE_SECTION_SOLAR 0
+#define STATE_SECTION_WEATHER 1
+#define STATE_SECTION_UV 2
+#define STATE_SECTION_READINGS 3
+#define STATE_SECTION_SENSORS 4
+#define STATE_SECTION_COUNT 5 // Section ids are stored in the file, only ever add new ones at the end
+
+// Field types in the state schema
+#define FIELD_INT 1
+#define FIELD_UINT 2
+#define FIELD_FLOAT 3
+#define FIELD_STRING 4 // NUL terminated char array, truncated if it shrinks
+#define FIELD_OPAQUE 5 // Copied only if the element size is unchanged
 
 // Log settings
 #define NORMAL_LOG_BUFFER_SIZE 500
 #define ERROR_LOG_BUFFER_SIZE 50
 
 #define SOLAR_TOKEN_LENGTH 2048
+#define UV_HOURS 24
+
+// MQTT ingest
+#define MQTT_QUEUE_LENGTH 64 // Messages buffered between the network thread and the ingest worker
+#define MQTT_INGEST_BATCH 16 // Most messages applied under one lock
+
+// Streaming JSON extraction
+#define JSON_MAX_FIELDS 40 // Fields one response can ask for
+#define JSON_MAX_DEPTH 16
+#define JSON_PATH_LEN 128
+#define JSON_SCALAR_LEN 64
+
+// Response arenas
+#define ARENA_MIN_SIZE 1024         // First size of an arena
+#define ARENA_MAX_SIZE (256 * 1024) // An arena never grows past this
 
 #endif // CONSTANTS_H
\ No newline at end of file
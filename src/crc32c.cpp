@@ -0,0 +1,109 @@
+#include "globals.h"
+
+// 64-bit builds always have the CRC32 instructions to hand. A 32-bit build only does when it is
+// compiled for them (-march=armv8-a+crc), the default 32-bit Raspberry Pi OS flags target ARMv6.
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FEATURE_CRC32))
+#define CRC32C_HARDWARE
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#ifndef HWCAP2_CRC32
+#define HWCAP2_CRC32 (1 << 4)
+#endif
+#endif
+
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), used to check the persisted data blocks.
+// The Pi 3/4/5 and Zero 2 cores have CRC32 instructions, elsewhere a slicing-by-8 table does 8
+// bytes per step.
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crcTable[8][256];
+#if defined(CRC32C_HARDWARE)
+static bool crcHardware = false;
+#endif
+static std::once_flag crcInitFlag;
+
+static void crc32c_init() {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crcTable[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^ crcTable[0][crcTable[t - 1][i] & 0xFF];
+        }
+    }
+#if defined(__aarch64__)
+    crcHardware = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(CRC32C_HARDWARE)
+    crcHardware = (getauxval(AT_HWCAP2) & HWCAP2_CRC32) != 0;
+#endif
+}
+
+static uint32_t crc32c_slice8(uint32_t crc, const uint8_t* bytes, size_t size) {
+    while (size && ((uintptr_t)bytes & 7)) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *bytes++) & 0xFF];
+        size--;
+    }
+    while (size >= 8) {
+        uint32_t low;
+        uint32_t high;
+        memcpy(&low, bytes, 4);
+        memcpy(&high, bytes + 4, 4);
+        low ^= crc;
+        crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^ crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^ crcTable[3][high & 0xFF] ^
+              crcTable[2][(high >> 8) & 0xFF] ^ crcTable[1][(high >> 16) & 0xFF] ^ crcTable[0][high >> 24];
+        bytes += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *bytes++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__aarch64__)
+__attribute__((target("+crc"))) static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* bytes, size_t size) {
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        crc = __crc32cd(crc, word);
+        bytes += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = __crc32cb(crc, *bytes++);
+    }
+    return crc;
+}
+#elif defined(CRC32C_HARDWARE)
+static uint32_t crc32c_hardware(uint32_t crc, const uint8_t* bytes, size_t size) {
+    while (size >= 4) {
+        uint32_t word;
+        memcpy(&word, bytes, 4);
+        crc = __crc32cw(crc, word);
+        bytes += 4;
+        size -= 4;
+    }
+    while (size--) {
+        crc = __crc32cb(crc, *bytes++);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(const void* data_ptr, size_t size) {
+    std::call_once(crcInitFlag, crc32c_init);
+    const uint8_t* bytes = (const uint8_t*)data_ptr;
+#if defined(CRC32C_HARDWARE)
+    if (crcHardware) {
+        return ~crc32c_hardware(0xFFFFFFFFu, bytes, size);
+    }
+#endif
+    return ~crc32c_slice8(0xFFFFFFFFu, bytes, size);
+}
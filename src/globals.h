@@ -17,20 +17,66 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <atomic>
+#include <curl/curl.h>
 #include <mutex>
 
-typedef struct __attribute__((packed)) { // Array to hold the incoming measurement
-    char description[CHAR_LEN];    // Currently set to 50 chars long
-    char topic[CHAR_LEN];          // MQTT topic
-    char output[CHAR_LEN];               // To be output to screen
-    float currentValue;                  // Current value received
-    float lastValue[STORED_READING];     // Defined that the zeroth element is the oldest
-    uint8_t changeChar;                  // To indicate change in status
-    bool enoughData;                     // to indicate is a full set of STORED_READING number of data points received
-    int dataType;                        // Type of data received
-    int readingIndex;                    // Index of current reading max will be STORED_READING
-    time_t lastMessageTime;              // Time this was last updated
-} Readings;
+// Cold per-sensor details, set once at startup and only needed to route messages and log
+typedef struct {
+    char description[CHAR_LEN]; // Room name shown on screen
+    char topic[CHAR_LEN];       // MQTT topic
+    int dataType;               // Type of data received
+} ReadingInfo;
+
+// Sensors found through TOPIC_PATTERNS, persisted so they keep their slots across restarts
+typedef struct {
+    int count;
+    ReadingInfo info[MAX_READINGS];
+} DiscoveredSensors;
+
+typedef struct {
+    const char* filter; // MQTT topic filter, may use + and # wildcards
+    int dataType;
+} TopicPattern;
+
+// Rolling window of the last STORED_READING samples of one sensor, with a running sum so the
+// mean used for the trend is O(1).
+typedef struct __attribute__((packed)) {
+    float samples[STORED_READING]; // Ring buffer, the newest sample is at (total - 1) % STORED_READING
+    uint32_t total;                // Samples ever added
+    uint32_t count;                // Samples held, up to STORED_READING
+    double sum;                    // Running sum of held samples
+} ReadingHistory;
+
+// Hot sensor state, one contiguous array per field indexed by reading slot, so the render and
+// ingest paths only pull in the fields they touch and never the cold strings
+typedef struct __attribute__((packed)) {
+    float currentValue[MAX_READINGS];                 // Current value received
+    uint8_t changeChar[MAX_READINGS];                 // To indicate change in status
+    bool enoughData[MAX_READINGS];                    // to indicate is a full set of STORED_READING number of data points received
+    time_t lastMessageTime[MAX_READINGS];             // Time this was last updated
+    uint32_t generation[MAX_READINGS];                // Bumped by the producer on every change, screen redraws only on a new generation
+    ReadingHistory history[MAX_READINGS];             // Recent values, used for the trend
+    char output[MAX_READINGS][READING_OUTPUT_LEN];    // To be output to screen
+    uint64_t walSequence;                             // Last readings log record applied to the table
+} ReadingsTable;
+
+typedef struct {
+    float min;
+    float max;
+    float mean;
+    uint32_t count;
+} RollupStats;
+
+// One sensor update in the readings log, see wal.cpp
+typedef struct __attribute__((packed)) {
+    uint64_t sequence;
+    int64_t time;      // When the value arrived
+    uint16_t slot;     // Reading slot the value was applied to
+    uint16_t reserved;
+    float value;
+    uint32_t checksum; // CRC32C of the fields above
+} WalRecord;
 
 typedef struct __attribute__((packed)) {
     float temperature;
@@ -42,12 +88,15 @@ typedef struct __attribute__((packed)) {
     char windDir[CHAR_LEN];
     char description[CHAR_LEN];
     char time_string[CHAR_LEN];
+    uint32_t generation;
 } Weather;
 
 typedef struct __attribute__((packed)) {
     int index;
     time_t updateTime;
     char time_string[CHAR_LEN];
+    uint32_t generation;
+    float hourly[UV_HOURS]; // Today's forecast by local hour, from Open-Meteo
 } UV;
 
 typedef struct __attribute__((packed)) {
@@ -60,23 +109,116 @@ typedef struct __attribute__((packed)) {
     float batteryPower;
     float solarPower;
     char time[CHAR_LEN];
-    float today_battery_min;
-    float today_battery_max;
-    bool minmax_reset;
     float today_buy;
     float month_buy;
+    uint32_t generation;
 } Solar;
 
+typedef struct __attribute__((packed)) {
+    uint32_t magic;    // DATA_FILE_MAGIC
+    uint32_t checksum; // CRC32C of the data block
+    size_t size;       // Size of the data block that follows the header
+} DataHeader;
+
+// Where one section of the state file lives, see statestore.cpp
+typedef struct {
+    uint32_t offset[2];  // Page aligned offsets of the two copies
+    uint32_t active;     // Copy holding the current data
+    uint32_t size;       // Bytes used in the active copy, schema and data
+    uint32_t checksum;   // CRC32C of the used bytes of the active copy
+    uint64_t generation; // Bumped on every write, 0 if never written
+} StateSection;
+
+typedef struct {
+    uint32_t magic;    // STATE_FILE_MAGIC
+    uint32_t version;  // STATE_VERSION
+    uint32_t pageSize; // Page size the offsets were laid out with
+    uint32_t sectionCount;
+    uint64_t sequence; // Newest valid header copy wins
+    StateSection sections[STATE_MAX_SECTIONS];
+    uint32_t checksum; // CRC32C of the header up to here
+} StateHeader;
+
+// Describes one persisted field, written in front of each state section so a later build can
+// migrate it. Element (o, n) is at offset + o * outerStride + n * elementSize.
+typedef struct __attribute__((packed)) {
+    uint16_t tag;         // Stable id of the field within its section
+    uint8_t type;         // FIELD_*
+    uint8_t reserved;
+    uint32_t offset;      // Offset of the first element
+    uint32_t elementSize; // Size of one element, strings are one element
+    uint32_t count;       // Elements in the array, 1 for a plain field
+    uint32_t outerCount;  // Repeats for a field inside an array of structs, otherwise 1
+    uint32_t outerStride; // Distance between the repeats
+} FieldDescriptor;
+
+// Start of each copy of a state section, followed by fieldCount FieldDescriptors and the data
+typedef struct {
+    uint32_t fieldCount;
+    uint32_t dataOffset; // From the start of the copy
+    uint32_t dataSize;
+    uint32_t reserved;
+} SchemaPrefix;
+
+// Header written before CRC32C, still read so an upgrade keeps its state
 typedef struct __attribute__((packed)) {
     size_t size;      // Size of the data block that follows the header
     uint8_t checksum; // Simple XOR checksum of the data block
-} DataHeader;
+} LegacyDataHeader;
 
 typedef struct {
     char text[CHAR_LEN];
     int duration_s; // Duration in seconds
 } StatusMessage;
 
+// One field pulled out of a streamed JSON document
+typedef struct {
+    bool found;
+    double number; // Numbers, booleans as 0/1, and strings that hold a number
+    int text;      // Offset of a string value in the stream's text arena, -1 if not a string
+} JsonValue;
+
+// Reusable buffer, grown to the largest size asked of it and reset rather than freed, see arena.cpp
+typedef struct {
+    char* base;
+    size_t size;
+    size_t used;
+} Arena;
+
+// Incremental JSON extractor state, see jsonstream.cpp
+typedef struct {
+    const char* const* paths; // Fields wanted, as "key.key[index]"
+    int pathCount;
+    JsonValue values[JSON_MAX_FIELDS];
+    uint8_t state;
+    bool inKey;
+    int depth;
+    uint8_t containerType[JSON_MAX_DEPTH];
+    uint32_t containerIndex[JSON_MAX_DEPTH]; // Current element of an array
+    uint16_t containerPathLength[JSON_MAX_DEPTH];
+    bool containerPathTruncated[JSON_MAX_DEPTH];
+    char path[JSON_PATH_LEN]; // Path of the current key or value
+    uint16_t pathLength;
+    bool pathTruncated;
+    int match; // Field being read, -1 if the current value is not wanted
+    char scalar[JSON_SCALAR_LEN];
+    int scalarLength;
+    uint32_t unicode;
+    int unicodeDigits;
+    Arena* text;       // String values, bump allocated, a value that does not fit is left as not found
+    size_t valueStart; // Start of the string value being read in text
+} JsonStream;
+
+// Writer side of the shared data seqlock. Writers still serialise on dataMutex, but also bump
+// dataSequence around their changes so the UI can snapshot without ever taking the lock.
+class DataWriteGuard {
+public:
+    DataWriteGuard();
+    ~DataWriteGuard();
+    DataWriteGuard(const DataWriteGuard&) = delete;
+    DataWriteGuard& operator=(const DataWriteGuard&) = delete;
+};
+
 struct LogEntry {
     char message[CHAR_LEN];
     time_t timestamp;
@@ -88,7 +230,32 @@ void getBatteryStatus(float batteryValue, char* iconCharacterPtr, lv_color_t* co
 void* displayStatusMessages_t(void* pvParameters);
 void logAndPublish(const char* messageBuffer);
 void errorPublish(const char* messageBuffer);
+void statsPublish(const char* messageBuffer);
+void reportStats();
 void invalidateOldReadings();
+void wakeDisplay();
+uint64_t monotonicMicros();
+
+// Readings
+void readings_init();
+const char* reading_description(int index);
+const char* reading_topic(int index);
+int reading_data_type(int index);
+int readings_discover(const char* topic);
+void readings_migrated();
+void readings_flushed(const void* data_ptr);
+void copy_reading(ReadingsTable* dest, const ReadingsTable* src, int index);
+void history_add(ReadingHistory* history, float value);
+float history_mean(const ReadingHistory* history);
+
+// Topics
+uint32_t topic_hash(const char* topic);
+bool topic_index_build();
+bool topic_index_add(int slot);
+int topic_index_find(const char* topic);
+void topic_trie_build();
+int topic_pattern_match(const char* topic, int* dataType, char* room, size_t roomSize);
+int topic_subscriptions(const char** filters, int maxFilters);
 
 // Connections
 void mqtt_connect();
@@ -99,33 +266,97 @@ void* connectivity_manager_t(void* pvParameters);
 void on_connect_callback(struct mosquitto* mosq, void* obj, int rc);
 void on_disconnect_callback(struct mosquitto* mosq, void* obj, int rc);
 void on_message_callback(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg);
-void process_mqtt_message(const char* topic, char* payload, int payloadlen);
-void update_readings(char* recMessage, int index, int dataType);
+void mqtt_enqueue_message(const char* topic, const char* payload, int payloadlen);
+void* mqtt_ingest_t(void* pvParameters);
+void mqtt_report_stats();
+void update_readings(float value, int index, int dataType, time_t when);
 void update_temperature(char* recMessage, int index);
-void update_readings(char* recMessage, int index, int dataType);
 char* toLowercase(const char* source, char* buffer, size_t bufferSize);
 
 //  Screen updates
 int uv_color(float UV);
 void format_integer_with_commas(long long num, char* out, size_t outSize);
-void set_basic_text_color(lv_color_t color);
+void theme_init();
+void set_theme(bool isDay);
 void set_solar_values(const Solar* solar);
+void set_weather_values(const Weather* weather);
+void set_uv_values(const UV* uv, bool isDay);
+void set_status_indicator(lv_obj_t* indicator, int state, int* shownState);
 
 // APIs
-void* get_uv_t(void* pvParameters);
-void* get_weather_t(void* pvParameters);
-void* get_solar_token_t(void* pvParameters);
-void* get_current_solar_t(void* pvParameters);
-void* get_daily_solar_t(void* pvParameters);
-void* get_monthly_solar_t(void* pvParameters);
+int api_status(int source, bool fresh);
+void* api_scheduler_t(void* pvParameters);
 const char* degreesToDirection(double degrees);
 const char* wmoToText(int code, bool isDay);
 
+// http
+bool http_init();
+CURL* http_handle(CURL* curl);
+bool http_start(CURL* curl, void* owner);
+void http_run(int timeoutMs, void (*done)(void* owner, CURLcode res, long responseCode));
+void http_count_decoded(size_t bytes);
+void http_report_stats();
+
+// arena
+bool arena_reserve(Arena* arena, size_t size);
+char* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+void arena_report_stats();
+
+// jsonstream
+void json_stream_init(JsonStream* stream, const char* const* paths, int count, Arena* text);
+bool json_stream_feed(JsonStream* stream, const char* data, size_t size);
+bool json_stream_receive(JsonStream* stream, const char* data, size_t size, size_t received, int64_t expected);
+bool json_stream_finish(JsonStream* stream);
+bool json_stream_has(const JsonStream* stream, const char* path);
+bool json_stream_number(const JsonStream* stream, const char* path, double* number);
+const char* json_stream_string(const JsonStream* stream, const char* path);
+
+// crc32c
+uint32_t crc32c(const void* data_ptr, size_t size);
+
+// statestore
+bool state_open();
+bool state_restore(int section);
+long state_flush(const bool* due);
+
+// wal
+void wal_init();
+bool wal_append(WalRecord* records, int count);
+void wal_snapshot_written(uint64_t sequence);
+time_t wal_sync_due();
+void wal_sync(bool force);
+void wal_report_stats();
+
+// timeseries
+bool ts_open();
+void ts_append(int series, time_t time, float value);
+int ts_scan(int series, time_t from, time_t to, bool (*visit)(time_t time, float value, void* context), void* context);
+void ts_sync();
+void ts_report_stats();
+
+// rollups
+void rollup_add(int series, time_t time, float value);
+void record_sample(int series, time_t time, float value);
+void rollups_init();
+bool rollup_get(int series, int resolution, time_t time, RollupStats* stats);
+bool rollup_range(int series, int resolution, time_t from, time_t to, RollupStats* stats);
+
+// schema
+const FieldDescriptor* schema_fields(int section, int* count);
+void schema_migrate(int section, void* dst, size_t dstSize, const FieldDescriptor* srcFields, int srcCount, const void* src, size_t srcSize);
+
 // saveload
-uint8_t calculateChecksum(const void* data_ptr, size_t size);
-bool saveDataBlock(const char* filename, const void* data_ptr, size_t size);
+uint8_t calculateLegacyChecksum(const void* data_ptr, size_t size);
+bool saveDataBlock(const char* filename, const void* data_ptr, size_t size, mode_t mode);
 bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size);
+void markDataDirty(int section);
+void* persistence_t(void* pvParameters);
+void persistence_wake();
+void persistence_flush();
+void persistence_report_stats();
 bool initDataDirectory();
+void syncDataDirectory();
 void getDataFilePath(const char* filename, char* fullpath, size_t fullpath_size);
 
 #endif // GLOBALS_H
\ No newline at end of file
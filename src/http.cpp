@@ -0,0 +1,196 @@
+#include "globals.h"
+#include <curl/curl.h>
+
+// HTTP client for the API scheduler. Every transfer runs on one curl multi handle, driven from
+// the scheduler thread by http_run(), so requests to different hosts overlap and requests to the
+// same host reuse the multi's pooled connection. HTTP/2 is asked for, so concurrent requests to
+// one host share a single connection, and responses come compressed where the server can.
+// Each endpoint keeps its easy handle for its lifetime, and the handles share one DNS cache and
+// TLS session cache through a share object.
+static CURLM* httpMulti = NULL;
+static CURLSH* httpShare = NULL;
+static std::mutex httpShareLocks[CURL_LOCK_DATA_LAST];
+
+// Request counters, reported by http_report_stats()
+static std::mutex httpStatsMutex;
+static uint64_t httpRequests = 0;
+static uint64_t httpFailures = 0;
+static uint64_t httpConnects = 0;
+static uint64_t httpHandshakes = 0;
+static uint64_t httpHandshakeTotalUs = 0;
+static uint64_t httpLatencyTotalUs = 0;
+static uint64_t httpLatencyMaxUs = 0;
+static uint64_t httpBytesReceived = 0; // Headers and body as sent, before decompression
+static uint64_t httpBytesDecoded = 0;  // Bodies after decompression, counted by the caller
+static uint64_t httpVersion2 = 0;
+
+static void http_share_lock(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    (void)handle;
+    (void)access;
+    (void)userptr;
+    httpShareLocks[data].lock();
+}
+
+static void http_share_unlock(CURL* handle, curl_lock_data data, void* userptr) {
+    (void)handle;
+    (void)userptr;
+    httpShareLocks[data].unlock();
+}
+
+// Must run before the scheduler thread starts, curl_global_init is not thread safe
+bool http_init() {
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        logAndPublish("Failed to initialise curl");
+        return false;
+    }
+    httpMulti = curl_multi_init();
+    if (!httpMulti) {
+        logAndPublish("Failed to create curl multi handle");
+        return false;
+    }
+    curl_multi_setopt(httpMulti, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    httpShare = curl_share_init();
+    if (!httpShare) {
+        logAndPublish("Failed to create curl share, API calls will not share caches");
+        return true;
+    }
+    curl_share_setopt(httpShare, CURLSHOPT_LOCKFUNC, http_share_lock);
+    curl_share_setopt(httpShare, CURLSHOPT_UNLOCKFUNC, http_share_unlock);
+    curl_share_setopt(httpShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(httpShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return true;
+}
+
+// Reset an endpoint's handle to the common settings, creating it on first use
+CURL* http_handle(CURL* curl) {
+    if (curl) {
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) {
+            return NULL;
+        }
+    }
+    if (httpShare) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, httpShare);
+    }
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    // HTTP/2 over TLS when the server offers it, a request waits for a connection being set up
+    // to the same host rather than opening another. "" accepts every encoding curl can decode.
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    return curl;
+}
+
+// Queue a transfer, owner is handed back to the completion callback
+bool http_start(CURL* curl, void* owner) {
+    if (!httpMulti) {
+        return false;
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, owner);
+    return curl_multi_add_handle(httpMulti, curl) == CURLM_OK;
+}
+
+// Count new connections, handshake time, latency and size of a finished transfer
+static void http_record(CURL* curl, CURLcode res) {
+    long connects = 0;
+    curl_off_t connectTime = 0;
+    curl_off_t appConnectTime = 0;
+    curl_off_t totalTime = 0;
+    curl_off_t bodySize = 0;
+    long headerSize = 0;
+    long version = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectTime);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appConnectTime);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &totalTime);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &bodySize);
+    curl_easy_getinfo(curl, CURLINFO_HEADER_SIZE, &headerSize);
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+
+    std::lock_guard<std::mutex> lock(httpStatsMutex);
+    httpRequests++;
+    if (res != CURLE_OK) {
+        httpFailures++;
+    }
+    httpConnects += connects;
+    // App connect time is only set when this transfer did a TLS handshake
+    if (connects > 0 && appConnectTime > 0) {
+        httpHandshakes++;
+        httpHandshakeTotalUs += appConnectTime - connectTime;
+    }
+    httpLatencyTotalUs += totalTime;
+    if ((uint64_t)totalTime > httpLatencyMaxUs) {
+        httpLatencyMaxUs = totalTime;
+    }
+    httpBytesReceived += bodySize + headerSize;
+    if (version == CURL_HTTP_VERSION_2_0) {
+        httpVersion2++;
+    }
+}
+
+// Add the size of a body as the caller received it, so the stats show what compression saves
+void http_count_decoded(size_t bytes) {
+    std::lock_guard<std::mutex> lock(httpStatsMutex);
+    httpBytesDecoded += bytes;
+}
+
+// Move every queued transfer along, call done for each one that finished, then wait up to
+// timeoutMs for network activity
+void http_run(int timeoutMs, void (*done)(void* owner, CURLcode res, long responseCode)) {
+    if (!httpMulti) {
+        usleep(timeoutMs * 1000);
+        return;
+    }
+    int running;
+    curl_multi_perform(httpMulti, &running);
+
+    CURLMsg* msg;
+    int queued;
+    while ((msg = curl_multi_info_read(httpMulti, &queued)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL* curl = msg->easy_handle;
+        CURLcode res = msg->data.result;
+        void* owner = NULL;
+        long responseCode = 0;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, &owner);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+        http_record(curl, res);
+        curl_multi_remove_handle(httpMulti, curl);
+        done(owner, res, responseCode);
+    }
+
+    curl_multi_poll(httpMulti, NULL, 0, timeoutMs, NULL);
+}
+
+void http_report_stats() {
+    char stats_message[CHAR_LEN];
+    {
+        std::lock_guard<std::mutex> lock(httpStatsMutex);
+        if (httpRequests == 0) {
+            return;
+        }
+        snprintf(stats_message, CHAR_LEN,
+                 "HTTP %llu requests (%llu HTTP/2), %llu failed, %llu connects, %llu TLS handshakes avg %.1fms, latency avg %.1fms max %.1fms, %.1f KB received, %.1f KB decoded",
+                 (unsigned long long)httpRequests, (unsigned long long)httpVersion2, (unsigned long long)httpFailures, (unsigned long long)httpConnects,
+                 (unsigned long long)httpHandshakes, httpHandshakes ? httpHandshakeTotalUs / 1000.0 / httpHandshakes : 0.0, httpLatencyTotalUs / 1000.0 / httpRequests,
+                 httpLatencyMaxUs / 1000.0, httpBytesReceived / 1024.0, httpBytesDecoded / 1024.0);
+        httpRequests = 0;
+        httpFailures = 0;
+        httpConnects = 0;
+        httpHandshakes = 0;
+        httpHandshakeTotalUs = 0;
+        httpLatencyTotalUs = 0;
+        httpLatencyMaxUs = 0;
+        httpBytesReceived = 0;
+        httpBytesDecoded = 0;
+        httpVersion2 = 0;
+    }
+    statsPublish(stats_message);
+}
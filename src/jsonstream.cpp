@@ -0,0 +1,428 @@
+#include "globals.h"
+
+// Pulls a few named fields out of a JSON document as it downloads, without building a tree.
+// The document is fed in whatever chunks curl delivers, the parser keeps the path of the value
+// it is in ("current.temperature_2m", "data[0].uv") and only copies a value out when the path is
+// one that was asked for. Nothing is allocated, string values are bumped into the caller's arena.
+enum {
+    JS_VALUE,        // Expecting a value
+    JS_VALUE_OR_END, // Just after '[', expecting a value or ']'
+    JS_KEY,          // Expecting the opening quote of a key
+    JS_KEY_OR_END,   // Just after '{', expecting a key or '}'
+    JS_COLON,        // After a key
+    JS_AFTER_VALUE,  // Expecting ',' or the end of the container
+    JS_STRING,       // Inside a key or string value
+    JS_ESCAPE,       // After a backslash in a string
+    JS_UNICODE,      // Reading the hex digits of \uXXXX
+    JS_SCALAR,       // Inside a number, true, false or null
+    JS_DONE,         // Top level value complete
+    JS_ERROR,
+};
+
+enum {
+    JS_OBJECT,
+    JS_ARRAY,
+};
+
+void json_stream_init(JsonStream* stream, const char* const* paths, int count, Arena* text) {
+    stream->paths = paths;
+    stream->pathCount = count < JSON_MAX_FIELDS ? count : JSON_MAX_FIELDS;
+    for (int i = 0; i < stream->pathCount; i++) {
+        stream->values[i].found = false;
+        stream->values[i].number = 0;
+        stream->values[i].text = -1;
+    }
+    stream->state = JS_VALUE;
+    stream->depth = 0;
+    stream->pathLength = 0;
+    stream->pathTruncated = false;
+    stream->path[0] = '\0';
+    stream->match = -1;
+    stream->text = text;
+    arena_reset(text);
+}
+
+// Append to the current path, a path too long to hold can never match
+static void json_path_append(JsonStream* stream, char c) {
+    if (stream->pathLength < JSON_PATH_LEN - 1) {
+        stream->path[stream->pathLength++] = c;
+    } else {
+        stream->pathTruncated = true;
+    }
+}
+
+// Cut the path back to that of the enclosing container
+static void json_path_reset(JsonStream* stream) {
+    if (stream->depth == 0) {
+        stream->pathLength = 0;
+        stream->pathTruncated = false;
+    } else {
+        stream->pathLength = stream->containerPathLength[stream->depth - 1];
+        stream->pathTruncated = stream->containerPathTruncated[stream->depth - 1];
+    }
+}
+
+// Field wanted at the current path, -1 if none
+static int json_path_match(JsonStream* stream) {
+    if (stream->pathTruncated) {
+        return -1;
+    }
+    stream->path[stream->pathLength] = '\0';
+    for (int i = 0; i < stream->pathCount; i++) {
+        if (!stream->values[i].found && strcmp(stream->paths[i], stream->path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A value is starting, arrays name it by index, objects already have its key in the path
+static void json_value_start(JsonStream* stream) {
+    if (stream->depth > 0 && stream->containerType[stream->depth - 1] == JS_ARRAY) {
+        json_path_reset(stream);
+        char index[16];
+        int length = snprintf(index, sizeof(index), "[%u]", stream->containerIndex[stream->depth - 1]);
+        for (int i = 0; i < length; i++) {
+            json_path_append(stream, index[i]);
+        }
+    }
+    stream->match = json_path_match(stream);
+}
+
+static void json_text_append(JsonStream* stream, char c) {
+    if (stream->match < 0) {
+        return;
+    }
+    char* slot = arena_alloc(stream->text, 1);
+    if (slot) {
+        *slot = c;
+    } else {
+        stream->match = -1; // Too long to keep, left as not found
+        stream->text->used = stream->valueStart;
+    }
+}
+
+static void json_string_append(JsonStream* stream, char c) {
+    if (stream->inKey) {
+        json_path_append(stream, c);
+    } else {
+        json_text_append(stream, c);
+    }
+}
+
+// Encode a \u escape as UTF-8, surrogate pairs are not joined
+static void json_string_append_unicode(JsonStream* stream, uint32_t code) {
+    if (code < 0x80) {
+        json_string_append(stream, (char)code);
+    } else if (code < 0x800) {
+        json_string_append(stream, (char)(0xC0 | (code >> 6)));
+        json_string_append(stream, (char)(0x80 | (code & 0x3F)));
+    } else {
+        json_string_append(stream, (char)(0xE0 | (code >> 12)));
+        json_string_append(stream, (char)(0x80 | ((code >> 6) & 0x3F)));
+        json_string_append(stream, (char)(0x80 | (code & 0x3F)));
+    }
+}
+
+static void json_value_end(JsonStream* stream) {
+    stream->match = -1;
+    stream->state = stream->depth == 0 ? JS_DONE : JS_AFTER_VALUE;
+}
+
+static void json_scalar_end(JsonStream* stream) {
+    stream->scalar[stream->scalarLength] = '\0';
+    // null is left as not found, APIs send it for values they do not have
+    if (stream->match >= 0 && strcmp(stream->scalar, "null") != 0) {
+        JsonValue* value = &stream->values[stream->match];
+        value->found = true;
+        value->text = -1;
+        if (strcmp(stream->scalar, "true") == 0) {
+            value->number = 1;
+        } else if (strcmp(stream->scalar, "false") == 0) {
+            value->number = 0;
+        } else {
+            value->number = strtod(stream->scalar, NULL);
+        }
+    }
+    json_value_end(stream);
+}
+
+static void json_string_end(JsonStream* stream) {
+    if (stream->inKey) {
+        stream->state = JS_COLON;
+        return;
+    }
+    char* end = stream->match >= 0 ? arena_alloc(stream->text, 1) : NULL;
+    if (end) {
+        JsonValue* value = &stream->values[stream->match];
+        *end = '\0';
+        value->found = true;
+        value->number = strtod(&stream->text->base[stream->valueStart], NULL); // Some APIs quote their numbers
+        value->text = (int)stream->valueStart;
+    } else if (stream->match >= 0) {
+        stream->text->used = stream->valueStart;
+    }
+    json_value_end(stream);
+}
+
+static bool json_push(JsonStream* stream, int type) {
+    if (stream->depth >= JSON_MAX_DEPTH) {
+        return false;
+    }
+    stream->containerType[stream->depth] = type;
+    stream->containerIndex[stream->depth] = 0;
+    stream->containerPathLength[stream->depth] = stream->pathLength;
+    stream->containerPathTruncated[stream->depth] = stream->pathTruncated;
+    stream->depth++;
+    stream->match = -1;
+    stream->state = type == JS_OBJECT ? JS_KEY_OR_END : JS_VALUE_OR_END;
+    return true;
+}
+
+static bool json_pop(JsonStream* stream, int type) {
+    if (stream->depth == 0 || stream->containerType[stream->depth - 1] != type) {
+        return false;
+    }
+    stream->depth--;
+    json_path_reset(stream);
+    json_value_end(stream);
+    return true;
+}
+
+// Start of a value, c is its first character
+static bool json_value_begin(JsonStream* stream, char c) {
+    json_value_start(stream);
+    switch (c) {
+    case '{':
+        return json_push(stream, JS_OBJECT);
+    case '[':
+        return json_push(stream, JS_ARRAY);
+    case '"':
+        stream->inKey = false;
+        stream->valueStart = stream->text->used;
+        stream->state = JS_STRING;
+        return true;
+    default:
+        if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+            stream->scalar[0] = c;
+            stream->scalarLength = 1;
+            stream->state = JS_SCALAR;
+            return true;
+        }
+        return false;
+    }
+}
+
+static bool json_is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int json_hex(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool json_feed_char(JsonStream* stream, char c) {
+    switch (stream->state) {
+    case JS_STRING:
+        if (c == '"') {
+            json_string_end(stream);
+        } else if (c == '\\') {
+            stream->state = JS_ESCAPE;
+        } else {
+            json_string_append(stream, c);
+        }
+        return true;
+
+    case JS_ESCAPE:
+        stream->state = JS_STRING;
+        switch (c) {
+        case 'n':
+            json_string_append(stream, '\n');
+            return true;
+        case 't':
+            json_string_append(stream, '\t');
+            return true;
+        case 'r':
+            json_string_append(stream, '\r');
+            return true;
+        case 'b':
+            json_string_append(stream, '\b');
+            return true;
+        case 'f':
+            json_string_append(stream, '\f');
+            return true;
+        case 'u':
+            stream->unicode = 0;
+            stream->unicodeDigits = 0;
+            stream->state = JS_UNICODE;
+            return true;
+        default:
+            json_string_append(stream, c); // \" \\ \/
+            return true;
+        }
+
+    case JS_UNICODE: {
+        int digit = json_hex(c);
+        if (digit < 0) {
+            return false;
+        }
+        stream->unicode = stream->unicode << 4 | digit;
+        if (++stream->unicodeDigits == 4) {
+            json_string_append_unicode(stream, stream->unicode);
+            stream->state = JS_STRING;
+        }
+        return true;
+    }
+
+    case JS_SCALAR:
+        if (c == ',' || c == '}' || c == ']' || json_is_space(c)) {
+            json_scalar_end(stream);
+            return json_feed_char(stream, c); // The delimiter belongs to the container
+        }
+        if (stream->scalarLength < JSON_SCALAR_LEN - 1) {
+            stream->scalar[stream->scalarLength++] = c;
+        } else {
+            stream->match = -1;
+        }
+        return true;
+
+    default:
+        break;
+    }
+
+    if (json_is_space(c)) {
+        return true;
+    }
+
+    switch (stream->state) {
+    case JS_VALUE:
+        return json_value_begin(stream, c);
+
+    case JS_VALUE_OR_END:
+        if (c == ']') {
+            return json_pop(stream, JS_ARRAY);
+        }
+        return json_value_begin(stream, c);
+
+    case JS_KEY_OR_END:
+        if (c == '}') {
+            return json_pop(stream, JS_OBJECT);
+        }
+        // Fall through
+    case JS_KEY:
+        if (c != '"') {
+            return false;
+        }
+        json_path_reset(stream);
+        if (stream->pathLength > 0) {
+            json_path_append(stream, '.');
+        }
+        stream->inKey = true;
+        stream->state = JS_STRING;
+        return true;
+
+    case JS_COLON:
+        if (c != ':') {
+            return false;
+        }
+        stream->state = JS_VALUE;
+        return true;
+
+    case JS_AFTER_VALUE:
+        if (c == ',') {
+            if (stream->containerType[stream->depth - 1] == JS_ARRAY) {
+                stream->containerIndex[stream->depth - 1]++;
+                stream->state = JS_VALUE;
+            } else {
+                stream->state = JS_KEY;
+            }
+            return true;
+        }
+        if (c == '}') {
+            return json_pop(stream, JS_OBJECT);
+        }
+        if (c == ']') {
+            return json_pop(stream, JS_ARRAY);
+        }
+        return false;
+
+    default:
+        return false; // Anything after the top level value, or an earlier error
+    }
+}
+
+// Feed the next chunk of the document, false once it is known to be malformed
+bool json_stream_feed(JsonStream* stream, const char* data, size_t size) {
+    if (stream->state == JS_ERROR) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (!json_feed_char(stream, data[i])) {
+            stream->state = JS_ERROR;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Feed the next chunk of a response body, received bytes after its start. No string in the body is
+// longer than the body, so with room in the text arena for all of it so far none is dropped. The
+// expected length, -1 if not known, sizes the arena up front with the first chunk, so once it has
+// seen the largest response nothing more is allocated. If it cannot grow the long strings go missing.
+bool json_stream_receive(JsonStream* stream, const char* data, size_t size, size_t received, int64_t expected) {
+    size_t needed = received + size + 1;
+    if (expected > 0 && (size_t)expected + 1 > needed) {
+        needed = (size_t)expected + 1;
+    }
+    arena_reserve(stream->text, needed);
+    return json_stream_feed(stream, data, size);
+}
+
+// True if the whole document arrived and was well formed, a bare top level number ends here
+bool json_stream_finish(JsonStream* stream) {
+    if (stream->state == JS_SCALAR && stream->depth == 0) {
+        json_scalar_end(stream);
+    }
+    return stream->state == JS_DONE;
+}
+
+static const JsonValue* json_stream_value(const JsonStream* stream, const char* path) {
+    for (int i = 0; i < stream->pathCount; i++) {
+        if (strcmp(stream->paths[i], path) == 0) {
+            return stream->values[i].found ? &stream->values[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+bool json_stream_has(const JsonStream* stream, const char* path) {
+    return json_stream_value(stream, path) != NULL;
+}
+
+// Value at path as a number, strings are converted, true is 1 and false 0. A null value is not found.
+bool json_stream_number(const JsonStream* stream, const char* path, double* number) {
+    const JsonValue* value = json_stream_value(stream, path);
+    if (!value) {
+        return false;
+    }
+    *number = value->number;
+    return true;
+}
+
+// String value at path, NULL if it was missing or not a string
+const char* json_stream_string(const JsonStream* stream, const char* path) {
+    const JsonValue* value = json_stream_value(stream, path);
+    if (!value || value->text < 0) {
+        return NULL;
+    }
+    return &stream->text->base[value->text];
+}
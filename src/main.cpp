@@ -14,39 +14,58 @@ Arduino Core 0
 
 #include "globals.h"
 #include <SDL2/SDL.h>
+#include <chrono>
 #include <condition_variable>
 #include <queue>
+#include <sched.h>
 #include <signal.h>
 
 // Create network objects
 std::mutex dataMutex;
+std::atomic<uint32_t> dataSequence{0}; // Odd while a writer is mid-update
+static std::atomic<uint64_t> dataLockContended{0};
+static std::atomic<uint64_t> snapshotRetries{0};
 struct mosquitto* mosq = NULL;
 bool mqtt_connected = false;
 volatile bool running = true;
 
 // Threads
-pthread_t thread_mqtt, thread_weather, thread_uv, thread_solar_token, thread_current_solar, thread_daily_solar, thread_monthly_solar, thread_display_status,
-    thread_connectivity_manager;
+pthread_t thread_mqtt_ingest, thread_persistence, thread_api_scheduler, thread_display_status, thread_connectivity_manager;
+
+extern ReadingsTable readings;
+extern int numberOfReadings;
 
 // Global variables
 struct tm timeinfo;
-Weather weather = {0.0, 0.0, 0.0, 0.0, false, 0, "", "", "--:--:--"};
-UV uv = {0, 0, "--:--:--"};
-Solar solar = {0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, "--:--:--", 100, 0, false, 0.0, 0.0};
-Readings readings[]{READINGS_ARRAY};
+Weather weather = {0.0, 0.0, 0.0, 0.0, false, 0, "", "", "--:--:--", 0};
+UV uv = {0, 0, "--:--:--", 0, {0}};
+Solar solar = {0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, "--:--:--", 0.0, 0.0, 0};
 std::queue<StatusMessage> statusMessageQueue;
 std::mutex statusQueueMutex;
 std::condition_variable statusQueueCV;
-int numberOfReadings = sizeof(readings) / sizeof(readings[0]);
 char chip_id[CHAR_LEN];
 
 // Status messages
 char statusMessageValue[CHAR_LEN];
 
+// UI wakeup, producers call wakeDisplay() after publishing so new data is drawn straight away
+static std::mutex displayWakeMutex;
+static std::condition_variable displayWakeCV;
+static bool displayWakePending = false;
+static uint64_t displayWakeArrivalUs = 0; // Arrival time of the oldest update not yet drawn
+
+// Reading arrival to pixel latency
+static uint64_t latencyCount = 0;
+static uint64_t latencyTotalUs = 0;
+static uint64_t latencyMaxUs = 0;
+
 // Screen setting
 static lv_display_t* disp = NULL;
 static lv_indev_t* mouse = NULL;
 
+static void waitForDisplayWake(uint32_t delayMs);
+static bool readingNeedsInvalidating(const ReadingsTable* table, int index, time_t now);
+
 // Arrays of UI objects
 #define ROOM_COUNT 5
 static lv_obj_t** roomNames[ROOM_COUNT] = ROOM_NAME_LABELS;
@@ -63,6 +82,13 @@ void setup() {
       if (!initDataDirectory()) {
         printf("Warning: Could not initialize data directory, using current directory\n");
     }
+    if (!state_open()) {
+        printf("Warning: Could not open state file, saving to separate files\n");
+    }
+    if (!ts_open()) {
+        printf("Warning: Could not open history file, history will not be recorded\n");
+    }
+    rollups_init();
 
     // Initialize LVGL and SDL display
     lv_init();
@@ -74,30 +100,38 @@ void setup() {
         SDL_SetWindowTitle(window, "Klaussometer");
     }
 
-    if (loadDataBlock(SOLAR_DATA_FILENAME, &solar, sizeof(solar))) {
+    readings_init();
+
+    if (state_restore(STATE_SECTION_SOLAR)) {
         logAndPublish("Solar state restored OK");
     } else {
         logAndPublish("Solar state restore failed");
     }
 
-    if (loadDataBlock(WEATHER_DATA_FILENAME, &weather, sizeof(weather))) {
+    if (state_restore(STATE_SECTION_WEATHER)) {
         logAndPublish("Weather state restored OK");
     } else {
         logAndPublish("Weather state restore failed");
     }
 
-    if (loadDataBlock(UV_DATA_FILENAME, &uv, sizeof(uv))) {
+    if (state_restore(STATE_SECTION_UV)) {
         logAndPublish("UV state restored OK");
     } else {
         logAndPublish("UV state restore failed");
     }
 
-    if (loadDataBlock(READINGS_DATA_FILENAME, &readings, sizeof(readings))) {
+    if (state_restore(STATE_SECTION_READINGS)) {
         logAndPublish("Readings state restored OK");
-        invalidateOldReadings();
     } else {
         logAndPublish("Readings state restore failed");
     }
+    wal_init();
+    invalidateOldReadings();
+
+    pthread_create(&thread_persistence, NULL, persistence_t, NULL);
+
+    // Ingest worker must be running before messages can arrive
+    pthread_create(&thread_mqtt_ingest, NULL, mqtt_ingest_t, NULL);
 
     mosquitto_lib_init();
 
@@ -125,12 +159,12 @@ void setup() {
     lv_label_set_text(ui_Version, "");
 
     for (unsigned char i = 0; i < ROOM_COUNT; ++i) {
-        lv_label_set_text(*roomNames[i], readings[i].description);
-        lv_arc_set_value(*tempArcs[i], readings[i].currentValue);
+        lv_label_set_text(*roomNames[i], reading_description(i));
+        lv_arc_set_value(*tempArcs[i], readings.currentValue[i]);
         lv_obj_add_flag(*tempArcs[i], LV_OBJ_FLAG_HIDDEN);
-        lv_label_set_text(*tempLabels[i], readings[i].output);
+        lv_label_set_text(*tempLabels[i], readings.output[i]);
         lv_label_set_text(*directionLabels[i], "");
-        lv_label_set_text(*humidityLabels[i], readings[i + ROOM_COUNT].output);
+        lv_label_set_text(*humidityLabels[i], readings.output[i + ROOM_COUNT]);
         lv_label_set_text(*batteryLabels[i], "");
     }
 
@@ -166,33 +200,16 @@ void setup() {
     lv_obj_set_style_text_color(ui_SolarStatus, lv_color_hex(COLOR_RED), LV_PART_MAIN);
 
     // Set to night settings at first
-    lv_obj_set_style_bg_color(lv_scr_act(), lv_color_hex(COLOR_BLACK), LV_STATE_DEFAULT);
-    lv_obj_set_style_border_color(ui_Container1, lv_color_hex(COLOR_WHITE), LV_STATE_DEFAULT);
-    lv_obj_set_style_border_color(ui_Container2, lv_color_hex(COLOR_WHITE), LV_STATE_DEFAULT);
+    theme_init();
+    set_theme(false);
 
     lv_label_set_text(ui_GridBought, "Bought\nToday - Pending\nThis Month - Pending");
 
     lv_timer_handler();
 
-    // Get old battery min and max
-    /*storage.begin("KO");
-    solar.today_battery_min = storage.getFloat("solarmin");
-    if (isnan(solar.today_battery_min)) {
-        solar.today_battery_min = 100;
-    }
-    solar.today_battery_max = storage.getFloat("solarmax");
-    if (isnan(solar.today_battery_max)) {
-        solar.today_battery_max = 0;
-    }
-    storage.end();*/
-
     // Start tasks
-    pthread_create(&thread_weather, NULL, get_weather_t, NULL);
-    pthread_create(&thread_uv, NULL, get_uv_t, NULL);
-    pthread_create(&thread_solar_token, NULL, get_solar_token_t, NULL);
-    pthread_create(&thread_daily_solar, NULL, get_daily_solar_t, NULL);
-    pthread_create(&thread_monthly_solar, NULL, get_monthly_solar_t, NULL);
-    pthread_create(&thread_current_solar, NULL, get_current_solar_t, NULL);
+    http_init();
+    pthread_create(&thread_api_scheduler, NULL, api_scheduler_t, NULL);
     pthread_create(&thread_display_status, NULL, displayStatusMessages_t, NULL);
     pthread_create(&thread_connectivity_manager, NULL, connectivity_manager_t, NULL);
 }
@@ -206,166 +223,267 @@ void loop() {
     time_t now = time(NULL);
     localtime_r(&now, &timeinfo);
 
-    usleep(200000);
-    lv_timer_handler(); // Run GUI
+    // Consume any pending wakeup, remembering when the data arrived
+    uint64_t arrivalUs = 0;
+    {
+        std::lock_guard<std::mutex> lock(displayWakeMutex);
+        if (displayWakePending) {
+            arrivalUs = displayWakeArrivalUs;
+            displayWakePending = false;
+        }
+    }
 
-    // ===== Take snapshot of shared data under lock =====
-    Weather weather_copy;
-    UV uv_copy;
-    Solar solar_copy;
-    Readings readings_copy[sizeof(readings) / sizeof(readings[0])];
+    // ===== Take snapshot of changed shared data =====
+    // The copies live across passes, their generation is the one last pushed to the screen.
+    // Read against dataSequence rather than dataMutex, retrying if a writer got in mid-copy.
+    static bool firstPass = true;
+    static Weather weather_copy;
+    static UV uv_copy;
+    static Solar solar_copy;
+    static ReadingsTable readings_copy;
+    bool weatherChanged = false;
+    bool uvChanged = false;
+    bool solarChanged = false;
+    bool readingChanged[MAX_READINGS] = {false};
 
-    {
-        std::lock_guard<std::mutex> lock(dataMutex);
-        memcpy(&weather_copy, &weather, sizeof(Weather));
-        memcpy(&uv_copy, &uv, sizeof(UV));
-        memcpy(&solar_copy, &solar, sizeof(Solar));
-        memcpy(readings_copy, readings, sizeof(readings));
+    while (true) {
+        uint32_t sequence = dataSequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            snapshotRetries.fetch_add(1, std::memory_order_relaxed);
+            sched_yield();
+            continue;
+        }
+        if (firstPass || weatherChanged || weather.generation != weather_copy.generation) {
+            memcpy(&weather_copy, &weather, sizeof(Weather));
+            weatherChanged = true;
+        }
+        if (firstPass || uvChanged || uv.generation != uv_copy.generation) {
+            memcpy(&uv_copy, &uv, sizeof(UV));
+            uvChanged = true;
+        }
+        if (firstPass || solarChanged || solar.generation != solar_copy.generation) {
+            memcpy(&solar_copy, &solar, sizeof(Solar));
+            solarChanged = true;
+        }
+        for (int i = 0; i < numberOfReadings; i++) {
+            if (firstPass || readingChanged[i] || readings.generation[i] != readings_copy.generation[i]) {
+                copy_reading(&readings_copy, &readings, i);
+                readingChanged[i] = true;
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (dataSequence.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+        // A torn copy can carry the new generation, so the retry recopies everything copied in this pass
+        snapshotRetries.fetch_add(1, std::memory_order_relaxed);
     }
+    firstPass = false;
     // ===== End snapshot =====
 
     for (unsigned char i = 0; i < ROOM_COUNT; ++i) {
-        lv_arc_set_value(*tempArcs[i], readings_copy[i].currentValue);
-        lv_label_set_text(*tempLabels[i], readings_copy[i].output);
-        if (readings_copy[i].changeChar != CHAR_NO_MESSAGE) {
-            lv_obj_clear_flag(*tempArcs[i], LV_OBJ_FLAG_HIDDEN);
-        } else {
-            lv_obj_add_flag(*tempArcs[i], LV_OBJ_FLAG_HIDDEN);
+        if (readingChanged[i]) {
+            lv_arc_set_value(*tempArcs[i], readings_copy.currentValue[i]);
+            lv_label_set_text(*tempLabels[i], readings_copy.output[i]);
+            if (readings_copy.changeChar[i] != CHAR_NO_MESSAGE) {
+                lv_obj_clear_flag(*tempArcs[i], LV_OBJ_FLAG_HIDDEN);
+            } else {
+                lv_obj_add_flag(*tempArcs[i], LV_OBJ_FLAG_HIDDEN);
+            }
+            if (readings_copy.changeChar[i] == CHAR_NO_MESSAGE) {
+                snprintf(tempString, CHAR_LEN, "%c", CHAR_SAME);
+            } else {
+                snprintf(tempString, CHAR_LEN, "%c", readings_copy.changeChar[i]);
+            }
+            lv_label_set_text(*directionLabels[i], tempString);
         }
-        if (readings_copy[i].changeChar == CHAR_NO_MESSAGE) {
-            snprintf(tempString, CHAR_LEN, "%c", CHAR_SAME);
-        } else {
-            snprintf(tempString, CHAR_LEN, "%c", readings_copy[i].changeChar);
+        if (readingChanged[i + ROOM_COUNT]) {
+            lv_label_set_text(*humidityLabels[i], readings_copy.output[i + ROOM_COUNT]);
         }
-        lv_label_set_text(*directionLabels[i], tempString);
-        lv_label_set_text(*humidityLabels[i], readings_copy[i + ROOM_COUNT].output);
     }
 
     // Battery updates - use readings_copy
     for (unsigned char i = 0; i < ROOM_COUNT; ++i) {
-        getBatteryStatus(readings_copy[i + 2 * ROOM_COUNT].currentValue, &batteryIcon, &batteryColour);
+        if (!readingChanged[i + 2 * ROOM_COUNT]) {
+            continue;
+        }
+        getBatteryStatus(readings_copy.currentValue[i + 2 * ROOM_COUNT], &batteryIcon, &batteryColour);
         snprintf(tempString, CHAR_LEN, "%c", batteryIcon);
         lv_label_set_text(*batteryLabels[i], tempString);
         lv_obj_set_style_text_color(*batteryLabels[i], batteryColour, LV_PART_MAIN);
     }
 
-    // Update UV - use uv_copy and weather_copy
-    if (uv_copy.updateTime > 0) {
-        lv_obj_clear_flag(ui_UVArc, LV_OBJ_FLAG_HIDDEN);
-        if (weather_copy.isDay) {
-            snprintf(tempString, sizeof(tempString), "Updated %.238s", uv_copy.time_string);
-        } else {
-            tempString[0] = '\0';
-        }
-        lv_label_set_text(ui_UVUpdateTime, tempString);
-        snprintf(tempString, CHAR_LEN, "%i", uv_copy.index);
-        lv_label_set_text(ui_UVLabel, tempString);
-        lv_arc_set_value(ui_UVArc, uv_copy.index * 10);
-
-        lv_obj_set_style_arc_color(ui_UVArc, lv_color_hex(uv_color(uv_copy.index)),
-                                   LV_PART_INDICATOR | LV_STATE_DEFAULT);
-        lv_obj_set_style_bg_color(ui_UVArc, lv_color_hex(uv_color(uv_copy.index)),
-                                  LV_PART_KNOB | LV_STATE_DEFAULT);
+    // Update UV - the update time depends on day/night so also redraw on weather changes
+    if (uvChanged || weatherChanged) {
+        set_uv_values(&uv_copy, weather_copy.isDay);
     }
 
     // Update weather values - use weather_copy
-    if (weather_copy.updateTime > 0) {
-        lv_label_set_text(ui_FCConditions, weather_copy.description);
-        snprintf(tempString, CHAR_LEN, "Updated %.238s", weather_copy.time_string);
-        lv_label_set_text(ui_FCUpdateTime, tempString);
-        char windString[CHAR_LEN + 20];
-        snprintf(windString, sizeof(windString), "Wind %2.0f km/h %s", weather_copy.windSpeed, weather_copy.windDir);
-        lv_label_set_text(ui_FCWindSpeed, windString);
-
-        lv_arc_set_value(ui_TempArcFC, weather_copy.temperature);
-
-        snprintf(tempString, CHAR_LEN, "%2.0f", weather_copy.temperature);
-        lv_label_set_text(ui_TempLabelFC, tempString);
-
-        // Update min/max on the COPY first, then write back if changed
-        bool minmax_changed = false;
-        if (weather_copy.temperature < weather_copy.minTemp) {
-            weather_copy.minTemp = weather_copy.temperature;
-            minmax_changed = true;
-        }
-        if (weather_copy.temperature > weather_copy.maxTemp) {
-            weather_copy.maxTemp = weather_copy.temperature;
-            minmax_changed = true;
-        }
-        
-        // Write back min/max changes under lock
-        if (minmax_changed) {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            weather.minTemp = weather_copy.minTemp;
-            weather.maxTemp = weather_copy.maxTemp;
+    if (weatherChanged) {
+        set_weather_values(&weather_copy);
+    }
+
+    // Update solar values - use solar_copy
+    if (solarChanged) {
+        set_solar_values(&solar_copy);
+    }
+
+    // Status indicators age with time rather than with a generation, so track what is shown
+    static int solarStatusShown = 0;
+    static int weatherStatusShown = 0;
+    static int wifiStatusShown = 0;
+    static int serverStatusShown = 0;
+    // Stale data is down whatever the API state, fresh data from a failing API is degraded
+    int solarStatus = api_status(API_SOURCE_SOLAR, now - solar_copy.currentUpdateTime <= 2 * SOLAR_CURRENT_UPDATE_INTERVAL_SEC);
+    int weatherStatus = api_status(API_SOURCE_WEATHER, now - weather_copy.updateTime <= 2 * WEATHER_UPDATE_INTERVAL_SEC);
+    set_status_indicator(ui_SolarStatus, solarStatus, &solarStatusShown);
+    set_status_indicator(ui_WeatherStatus, weatherStatus, &weatherStatusShown);
+    set_status_indicator(ui_WiFiStatus, mqtt_connected ? STATUS_OK : STATUS_DOWN, &wifiStatusShown);
+    set_status_indicator(ui_ServerStatus, mqtt_connected ? STATUS_OK : STATUS_DOWN, &serverStatusShown);
+
+    static time_t timeShown = 0;
+    if (now != timeShown) {
+        timeShown = now;
+        char timeString[CHAR_LEN];
+        strftime(timeString, sizeof(timeString), "%H:%M:%S", &timeinfo);
+        lv_label_set_text(ui_Time, timeString);
+    }
+
+    if (weatherChanged) {
+        set_theme(weather_copy.isDay);
+    }
+
+    // Update status message
+    static char statusMessageShown[CHAR_LEN] = "";
+    if (strcmp(statusMessageValue, statusMessageShown) != 0) {
+        snprintf(statusMessageShown, CHAR_LEN, "%s", statusMessageValue);
+        lv_label_set_text(ui_StatusMessage, statusMessageShown);
+    }
+
+    // Invalidate readings if too old - only take the write lock when the snapshot shows one is due
+    for (int i = 0; i < numberOfReadings; i++) {
+        if (readingNeedsInvalidating(&readings_copy, i, now)) {
+            invalidateOldReadings();
+            break;
         }
     }
 
-    if (weather_copy.updateTime > 0) {
-        snprintf(tempString, CHAR_LEN, "%2.0f°C", weather_copy.minTemp);
-        lv_label_set_text(ui_FCMin, tempString);
-        snprintf(tempString, CHAR_LEN, "%2.0f°C", weather_copy.maxTemp);
-        lv_label_set_text(ui_FCMax, tempString);
-        lv_obj_clear_flag(ui_TempArcFC, LV_OBJ_FLAG_HIDDEN);
-        lv_arc_set_range(ui_TempArcFC, weather_copy.minTemp, weather_copy.maxTemp);
+    // Draw woken updates now rather than on the next refresh period, then account the latency
+    if (arrivalUs != 0) {
+        lv_refr_now(disp);
+        uint64_t latencyUs = monotonicMicros() - arrivalUs;
+        latencyCount++;
+        latencyTotalUs += latencyUs;
+        if (latencyUs > latencyMaxUs) {
+            latencyMaxUs = latencyUs;
+        }
     }
 
-    // Update solar values - use solar_copy
-    set_solar_values(&solar_copy);  // Pass copy to function
-    
-    if (time(NULL) - solar_copy.currentUpdateTime > 2 * SOLAR_CURRENT_UPDATE_INTERVAL_SEC) {
-        lv_obj_set_style_text_color(ui_SolarStatus, lv_color_hex(COLOR_RED), LV_PART_MAIN);
-    } else {
-        lv_obj_set_style_text_color(ui_SolarStatus, lv_color_hex(COLOR_GREEN), LV_PART_MAIN);
+    static time_t lastStatsReport = now;
+    if (now - lastStatsReport >= STATS_REPORT_INTERVAL_SEC) {
+        lastStatsReport = now;
+        reportStats();
     }
-    if (time(NULL) - weather_copy.updateTime > 2 * WEATHER_UPDATE_INTERVAL_SEC) {
-        lv_obj_set_style_text_color(ui_WeatherStatus, lv_color_hex(COLOR_RED), LV_PART_MAIN);
-    } else {
-        lv_obj_set_style_text_color(ui_WeatherStatus, lv_color_hex(COLOR_GREEN), LV_PART_MAIN);
+
+    uint32_t delayMs = lv_timer_handler(); // Run GUI
+    waitForDisplayWake(delayMs);
+}
+
+// Sleep until a producer wakes the display or LVGL next needs servicing.
+// Capped at the next second boundary so the clock keeps ticking.
+static void waitForDisplayWake(uint32_t delayMs) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint32_t untilNextSecondMs = 1000 - ts.tv_nsec / 1000000;
+    if (delayMs > untilNextSecondMs) {
+        delayMs = untilNextSecondMs;
     }
 
-    if (mqtt_connected) {
-        lv_obj_set_style_text_color(ui_WiFiStatus, lv_color_hex(COLOR_GREEN), LV_PART_MAIN);
-    } else {
-        lv_obj_set_style_text_color(ui_WiFiStatus, lv_color_hex(COLOR_RED), LV_PART_MAIN);
+    if (UI_FIXED_CADENCE_MS > 0) {
+        // Old fixed polling cadence, kept to compare latency against
+        usleep(UI_FIXED_CADENCE_MS * 1000);
+        return;
     }
 
-    if (mqtt_connected) {
-        lv_obj_set_style_text_color(ui_ServerStatus, lv_color_hex(COLOR_GREEN), LV_PART_MAIN);
-    } else {
-        lv_obj_set_style_text_color(ui_ServerStatus, lv_color_hex(COLOR_RED), LV_PART_MAIN);
+    std::unique_lock<std::mutex> lock(displayWakeMutex);
+    displayWakeCV.wait_for(lock, std::chrono::milliseconds(delayMs), [] {
+        return displayWakePending;
+    });
+}
+
+DataWriteGuard::DataWriteGuard() {
+    if (!dataMutex.try_lock()) {
+        dataLockContended.fetch_add(1, std::memory_order_relaxed);
+        dataMutex.lock();
     }
+    dataSequence.store(dataSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
 
-    char timeString[CHAR_LEN];
-    strftime(timeString, sizeof(timeString), "%H:%M:%S", &timeinfo);
-    lv_label_set_text(ui_Time, timeString);
+DataWriteGuard::~DataWriteGuard() {
+    dataSequence.store(dataSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    dataMutex.unlock();
+}
 
-    if (!weather_copy.isDay) {
-        set_basic_text_color(lv_color_hex(COLOR_WHITE));
-        lv_obj_set_style_bg_color(lv_scr_act(), lv_color_hex(COLOR_BLACK), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(ui_Container1, lv_color_hex(COLOR_WHITE), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(ui_Container2, lv_color_hex(COLOR_WHITE), LV_STATE_DEFAULT);
-    } else {
-        set_basic_text_color(lv_color_hex(COLOR_BLACK));
-        lv_obj_set_style_bg_color(lv_scr_act(), lv_color_hex(COLOR_WHITE), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(ui_Container1, lv_color_hex(COLOR_BLACK), LV_STATE_DEFAULT);
-        lv_obj_set_style_border_color(ui_Container2, lv_color_hex(COLOR_BLACK), LV_STATE_DEFAULT);
+void wakeDisplay() {
+    {
+        std::lock_guard<std::mutex> lock(displayWakeMutex);
+        if (!displayWakePending) {
+            displayWakePending = true;
+            displayWakeArrivalUs = monotonicMicros();
+        }
     }
+    displayWakeCV.notify_one();
+}
 
-    // Update status message
-    lv_label_set_text(ui_StatusMessage, statusMessageValue);
+uint64_t monotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    // Invalidate readings if too old - needs lock since it modifies readings
-    invalidateOldReadings();
+// Periodic counters for tuning, printed to the console only
+void reportStats() {
+    char stats_message[CHAR_LEN];
+    if (latencyCount > 0) {
+        snprintf(stats_message, CHAR_LEN, "Update to screen latency avg %.1fms max %.1fms over %llu updates", latencyTotalUs / 1000.0 / latencyCount, latencyMaxUs / 1000.0,
+                 (unsigned long long)latencyCount);
+        statsPublish(stats_message);
+    }
+    latencyCount = 0;
+    latencyTotalUs = 0;
+    latencyMaxUs = 0;
+
+    mqtt_report_stats();
+    persistence_report_stats();
+    wal_report_stats();
+    ts_report_stats();
+    http_report_stats();
+    arena_report_stats();
+
+    snprintf(stats_message, CHAR_LEN, "Data lock contended %llu times, UI snapshot retries %llu",
+             (unsigned long long)dataLockContended.exchange(0, std::memory_order_relaxed), (unsigned long long)snapshotRetries.exchange(0, std::memory_order_relaxed));
+    statsPublish(stats_message);
+}
+
+// True once a reading is too old and has not yet been blanked. Blanking only on the
+// transition means stale readings don't bump their generation and redraw every pass.
+static bool readingNeedsInvalidating(const ReadingsTable* table, int index, time_t now) {
+    if (now <= table->lastMessageTime[index] + MAX_NO_MESSAGE_SEC) {
+        return false;
+    }
+    return !(table->changeChar[index] == CHAR_NO_MESSAGE && table->currentValue[index] == 0.0 && strcmp(table->output[index], NO_READING) == 0);
 }
 
 void invalidateOldReadings() {
-    std::lock_guard<std::mutex> lock(dataMutex);
-    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); i++) {
-        if ((time(NULL) > readings[i].lastMessageTime + (MAX_NO_MESSAGE_SEC))) {
-            readings[i].changeChar = CHAR_NO_MESSAGE;
-            snprintf(readings[i].output, 10, NO_READING);
-            readings[i].currentValue = 0.0;
+    DataWriteGuard publish;
+    time_t now = time(NULL);
+    for (int i = 0; i < numberOfReadings; i++) {
+        if (readingNeedsInvalidating(&readings, i, now)) {
+            readings.changeChar[i] = CHAR_NO_MESSAGE;
+            snprintf(readings.output[i], READING_OUTPUT_LEN, NO_READING);
+            readings.currentValue[i] = 0.0;
+            readings.generation[i]++;
         }
     }
 }
@@ -407,10 +525,12 @@ void* displayStatusMessages_t(void* pvParameters) {
             statusMessageQueue.pop();
         }
         snprintf(statusMessageValue, CHAR_LEN, "%s", receivedMsg.text);
+        wakeDisplay();
         // Wait for the specified duration before clearing the message.
         usleep(receivedMsg.duration_s * 1000000);
         // Clear the label after the duration has passed.
         statusMessageValue[0] = '\0';
+        wakeDisplay();
     }
     return NULL;
 }
@@ -432,6 +552,10 @@ void errorPublish(const char* messageBuffer) {
     printf("ERROR: %s\n", messageBuffer);
 }
 
+void statsPublish(const char* messageBuffer) {
+    printf("STATS: %s\n", messageBuffer);
+}
+
 void signal_handler(int sig) {
     (void)sig;
     running = false;
@@ -448,13 +572,16 @@ int main(int argc, char* argv[]) {
     
     while (running) {
         loop();
-        usleep(5000);
     }
     
     // Cleanup
     mosquitto_loop_stop(mosq, true);
     mosquitto_destroy(mosq);
     mosquitto_lib_cleanup();
+
+    // Write anything still waiting in the persistence window
+    persistence_flush();
+    ts_sync();
     
     printf("Klaussometer shutdown complete\n");
     return 0;
@@ -1,122 +1,235 @@
 #include "globals.h"
+#include <condition_variable>
 
 extern struct mosquitto* mosq;
-extern Readings readings[];
-extern int numberOfReadings;
+extern ReadingsTable readings;
 extern std::mutex dataMutex;
 
-// Process received MQTT message
-void process_mqtt_message(const char* topic, char* payload, int payloadlen) {
-    char recMessage[CHAR_LEN];
-
-    // Copy payload and null-terminate
-    if (payloadlen >= CHAR_LEN) {
+// Messages are handed from the mosquitto network thread to the ingest worker through a
+// single producer, single consumer ring, so slow work never stalls network I/O or keepalives
+typedef struct {
+    char topic[CHAR_LEN];
+    char payload[CHAR_LEN];
+} MqttMessage;
+
+static MqttMessage mqttQueue[MQTT_QUEUE_LENGTH];
+static std::atomic<uint32_t> mqttQueueHead{0}; // Next message to read, only the worker advances it
+static std::atomic<uint32_t> mqttQueueTail{0}; // Next free entry, only the network thread advances it
+static std::mutex ingestMutex;
+static std::condition_variable ingestCV;
+
+// Queue counters, reported by mqtt_report_stats()
+static std::atomic<uint64_t> mqttQueued{0};
+static std::atomic<uint64_t> mqttDropped{0};
+static std::atomic<uint32_t> mqttMaxDepth{0};
+static std::atomic<uint64_t> ingestBatches{0};
+
+static const char* data_type_name(int dataType);
+
+// Called on the mosquitto network thread, copies the message and returns straight away
+void mqtt_enqueue_message(const char* topic, const char* payload, int payloadlen) {
+    if (payloadlen >= CHAR_LEN || strlen(topic) >= CHAR_LEN) {
         logAndPublish("MQTT message exceeds buffer size");
         return;
     }
 
-    memcpy(recMessage, payload, payloadlen);
-    recMessage[payloadlen] = '\0';
-
-    // Validate message
-    if (payloadlen == 0 || recMessage[0] == '\0') {
-        char log_msg[CHAR_LEN];
-        snprintf(log_msg, CHAR_LEN, "Empty MQTT message on topic: %s", topic);
-        logAndPublish(log_msg);
+    uint32_t tail = mqttQueueTail.load(std::memory_order_relaxed);
+    uint32_t depth = tail - mqttQueueHead.load(std::memory_order_acquire);
+    if (depth >= MQTT_QUEUE_LENGTH) {
+        mqttDropped.fetch_add(1, std::memory_order_relaxed);
         return;
     }
 
-    // Find matching topic and process
-    bool messageProcessed = false;
-    for (int i = 0; i < numberOfReadings; i++) {
-        if (strcmp(topic, readings[i].topic) == 0) {
-            if (readings[i].dataType == DATA_TEMPERATURE || readings[i].dataType == DATA_HUMIDITY || readings[i].dataType == DATA_BATTERY) {
-                {
-                    std::lock_guard<std::mutex> lock(dataMutex);
-                    update_readings(recMessage, i, readings[i].dataType);
+    MqttMessage* message = &mqttQueue[tail % MQTT_QUEUE_LENGTH];
+    snprintf(message->topic, CHAR_LEN, "%s", topic);
+    memcpy(message->payload, payload, payloadlen);
+    message->payload[payloadlen] = '\0';
+    mqttQueueTail.store(tail + 1, std::memory_order_release);
+
+    mqttQueued.fetch_add(1, std::memory_order_relaxed);
+    if (depth + 1 > mqttMaxDepth.load(std::memory_order_relaxed)) {
+        mqttMaxDepth.store(depth + 1, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ingestMutex);
+    }
+    ingestCV.notify_one();
+}
+
+// Ingest worker, drains the queue in batches and applies each batch under one lock
+void* mqtt_ingest_t(void* pvParameters) {
+    (void)pvParameters;
+    int slots[MQTT_INGEST_BATCH];
+    int dataTypes[MQTT_INGEST_BATCH];
+    WalRecord records[MQTT_INGEST_BATCH];
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(ingestMutex);
+            ingestCV.wait(lock, [] {
+                return mqttQueueHead.load(std::memory_order_relaxed) != mqttQueueTail.load(std::memory_order_acquire);
+            });
+        }
+
+        uint32_t head = mqttQueueHead.load(std::memory_order_relaxed);
+        uint32_t count = mqttQueueTail.load(std::memory_order_acquire) - head;
+        if (count > MQTT_INGEST_BATCH) {
+            count = MQTT_INGEST_BATCH;
+        }
+
+        // Validate and route outside the lock, discovering a new sensor takes the lock itself
+        for (uint32_t n = 0; n < count; n++) {
+            MqttMessage* message = &mqttQueue[(head + n) % MQTT_QUEUE_LENGTH];
+            slots[n] = -1;
+            if (message->payload[0] == '\0') {
+                char log_msg[CHAR_LEN];
+                snprintf(log_msg, CHAR_LEN, "Empty MQTT message on topic: %.200s", message->topic);
+                logAndPublish(log_msg);
+                continue;
+            }
+
+            int i = topic_index_find(message->topic);
+            if (i < 0) {
+                i = readings_discover(message->topic);
+            }
+            if (i >= 0) {
+                dataTypes[n] = reading_data_type(i);
+                if (dataTypes[n] == DATA_TEMPERATURE || dataTypes[n] == DATA_HUMIDITY || dataTypes[n] == DATA_BATTERY) {
+                    slots[n] = i;
                 }
-                messageProcessed = true;
             }
-            break;
+            if (slots[n] < 0) {
+                char log_msg[CHAR_LEN];
+                snprintf(log_msg, CHAR_LEN, "Unhandled MQTT topic: %.100s, message: %.100s", message->topic, message->payload);
+                logAndPublish(log_msg);
+            }
         }
-    }
 
-    if (!messageProcessed) {
-        char log_msg[CHAR_LEN];
-        snprintf(log_msg, CHAR_LEN, "Unhandled MQTT topic: %.100s, message: %.100s", topic, recMessage);
-        logAndPublish(log_msg);
+        // Log the batch before applying it, the readings snapshot is only rewritten on compaction
+        int numberOfRecords = 0;
+        time_t now = time(NULL);
+        for (uint32_t n = 0; n < count; n++) {
+            if (slots[n] >= 0) {
+                WalRecord* record = &records[numberOfRecords++];
+                memset(record, 0, sizeof(WalRecord));
+                record->time = now;
+                record->slot = slots[n];
+                record->value = atof(mqttQueue[(head + n) % MQTT_QUEUE_LENGTH].payload);
+            }
+        }
+        bool logged = numberOfRecords > 0 && wal_append(records, numberOfRecords);
+
+        {
+            DataWriteGuard publish;
+            for (int n = 0; n < numberOfRecords; n++) {
+                update_readings(records[n].value, records[n].slot, reading_data_type(records[n].slot), now);
+            }
+            if (logged) {
+                readings.walSequence = records[numberOfRecords - 1].sequence;
+            }
+        }
+        mqttQueueHead.store(head + count, std::memory_order_release);
+        ingestBatches.fetch_add(1, std::memory_order_relaxed);
+
+        // The batch shares one timestamp and the history keeps the first sample at a time,
+        // so only the newest value of each sensor is recorded
+        for (int n = 0; n < numberOfRecords; n++) {
+            bool newest = true;
+            for (int later = n + 1; later < numberOfRecords && newest; later++) {
+                newest = records[later].slot != records[n].slot;
+            }
+            if (newest) {
+                record_sample(TS_SERIES_READING(records[n].slot), now, records[n].value);
+            }
+        }
+
+        if (numberOfRecords > 0) {
+            wakeDisplay();
+            if (!logged) {
+                markDataDirty(STATE_SECTION_READINGS);
+            }
+
+            for (uint32_t n = 0; n < count; n++) {
+                if (slots[n] >= 0) {
+                    char log_message[CHAR_LEN];
+                    snprintf(log_message, CHAR_LEN, "%s %s updated", reading_description(slots[n]), data_type_name(dataTypes[n]));
+                    logAndPublish(log_message);
+                }
+            }
+        }
     }
+    return NULL;
+}
 
-    saveDataBlock(READINGS_DATA_FILENAME, readings, sizeof(Readings) * numberOfReadings);
+void mqtt_report_stats() {
+    char stats_message[CHAR_LEN];
+    uint32_t depth = mqttQueueTail.load(std::memory_order_relaxed) - mqttQueueHead.load(std::memory_order_relaxed);
+    snprintf(stats_message, CHAR_LEN, "MQTT queue depth %u max %u, %llu queued, %llu dropped, %llu batches", depth, mqttMaxDepth.exchange(0, std::memory_order_relaxed),
+             (unsigned long long)mqttQueued.exchange(0, std::memory_order_relaxed), (unsigned long long)mqttDropped.exchange(0, std::memory_order_relaxed),
+             (unsigned long long)ingestBatches.exchange(0, std::memory_order_relaxed));
+    statsPublish(stats_message);
 }
 
-void update_readings(char* recMessage, int index, int dataType) {
-    float averageHistory;
-    float totalHistory = 0.0;
-    const char* log_message_suffix;
+static const char* data_type_name(int dataType) {
+    switch (dataType) {
+    case DATA_TEMPERATURE:
+        return "temperature";
+    case DATA_HUMIDITY:
+        return "humidity";
+    case DATA_BATTERY:
+        return "battery";
+    default:
+        return "reading";
+    }
+}
+
+// Apply one message to its slot, caller holds a DataWriteGuard
+void update_readings(float value, int index, int dataType, time_t when) {
     const char* format_string;
 
-    readings[index].currentValue = atof(recMessage);
+    readings.currentValue[index] = value;
 
     // Set format string and log suffix based on data type
     switch (dataType) {
     case DATA_TEMPERATURE:
         format_string = "%2.1f";
-        log_message_suffix = "temperature";
         break;
     case DATA_HUMIDITY:
         format_string = "%2.0f%s";
-        log_message_suffix = "humidity";
         break;
     case DATA_BATTERY:
         format_string = "%2.1f";
-        log_message_suffix = "battery";
         break;
     default:
         return;
     }
 
     if (dataType == DATA_HUMIDITY) {
-        snprintf(readings[index].output, 10, format_string, readings[index].currentValue, "%");
+        snprintf(readings.output[index], READING_OUTPUT_LEN, format_string, readings.currentValue[index], "%");
     } else {
-        snprintf(readings[index].output, 10, format_string, readings[index].currentValue);
+        snprintf(readings.output[index], READING_OUTPUT_LEN, format_string, readings.currentValue[index]);
     }
 
-    if (readings[index].readingIndex == 0) {
-        readings[index].changeChar = CHAR_BLANK;
-        readings[index].lastValue[0] = readings[index].currentValue;
+    ReadingHistory* history = &readings.history[index];
+    if (history->count == 0) {
+        readings.changeChar[index] = CHAR_BLANK;
     } else {
-        for (int i = 0; i < readings[index].readingIndex; i++) {
-            totalHistory += readings[index].lastValue[i];
-        }
-        averageHistory = totalHistory / readings[index].readingIndex;
+        float averageHistory = history_mean(history);
 
         if (dataType == DATA_TEMPERATURE || dataType == DATA_HUMIDITY) {
-            if (readings[index].currentValue > averageHistory) {
-                readings[index].changeChar = CHAR_UP;
-            } else if (readings[index].currentValue < averageHistory) {
-                readings[index].changeChar = CHAR_DOWN;
+            if (readings.currentValue[index] > averageHistory) {
+                readings.changeChar[index] = CHAR_UP;
+            } else if (readings.currentValue[index] < averageHistory) {
+                readings.changeChar[index] = CHAR_DOWN;
             } else {
-                readings[index].changeChar = CHAR_SAME;
+                readings.changeChar[index] = CHAR_SAME;
             }
         }
     }
 
-    if (readings[index].readingIndex == STORED_READING) {
-        readings[index].readingIndex--;
-        readings[index].enoughData = true;
-        for (int i = 0; i < STORED_READING - 1; i++) {
-            readings[index].lastValue[i] = readings[index].lastValue[i + 1];
-        }
-    } else {
-        readings[index].enoughData = false;
-    }
-
-    readings[index].lastValue[readings[index].readingIndex] = readings[index].currentValue;
-    readings[index].readingIndex++;
-    readings[index].lastMessageTime = time(NULL);
-
-    char log_message[CHAR_LEN];
-    snprintf(log_message, CHAR_LEN, "%s %s updated", readings[index].description, log_message_suffix);
-    logAndPublish(log_message);
+    readings.enoughData[index] = (history->count == STORED_READING);
+    history_add(history, readings.currentValue[index]);
+    readings.lastMessageTime[index] = when;
+    readings.generation[index]++;
 }
\ No newline at end of file
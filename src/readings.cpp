@@ -0,0 +1,164 @@
+#include "globals.h"
+
+// Sensor table, hot state in readings and cold details in readingInfo, both indexed by slot
+ReadingsTable readings;
+static ReadingInfo readingInfo[MAX_READINGS];
+int numberOfReadings = 0;
+
+static const ReadingInfo defaultReadings[] = {READINGS_ARRAY};
+static int numberOfDefaultReadings = 0;
+DiscoveredSensors discovered;
+
+static void readings_add_slot(const ReadingInfo* info);
+
+// Fill the table from READINGS_ARRAY and previously discovered sensors, must run before any
+// state is restored so restored readings line up with their slots
+void readings_init() {
+    int defaults = sizeof(defaultReadings) / sizeof(defaultReadings[0]);
+    if (defaults > MAX_READINGS) {
+        errorPublish("READINGS_ARRAY is larger than MAX_READINGS, extra sensors ignored");
+        defaults = MAX_READINGS;
+    }
+
+    memset(&readings, 0, sizeof(readings));
+    numberOfReadings = 0;
+    for (int i = 0; i < defaults; i++) {
+        readings_add_slot(&defaultReadings[i]);
+    }
+    numberOfDefaultReadings = numberOfReadings;
+
+    memset(&discovered, 0, sizeof(discovered));
+    if (state_restore(STATE_SECTION_SENSORS)) {
+        if (discovered.count < 0 || discovered.count > MAX_READINGS - numberOfDefaultReadings) {
+            discovered.count = 0;
+        }
+        for (int i = 0; i < discovered.count; i++) {
+            readings_add_slot(&discovered.info[i]);
+        }
+    }
+
+    topic_trie_build();
+    topic_index_build();
+}
+
+static void readings_add_slot(const ReadingInfo* info) {
+    int slot = numberOfReadings;
+    readingInfo[slot] = *info;
+    readingInfo[slot].description[CHAR_LEN - 1] = '\0';
+    readingInfo[slot].topic[CHAR_LEN - 1] = '\0';
+    readings.changeChar[slot] = CHAR_NO_MESSAGE;
+    snprintf(readings.output[slot], READING_OUTPUT_LEN, NO_READING);
+    numberOfReadings++;
+}
+
+// History is dropped by a migration that changes its layout, keep enoughData in step with it
+void readings_migrated() {
+    DataWriteGuard publish;
+    for (int i = 0; i < MAX_READINGS; i++) {
+        readings.enoughData[i] = readings.history[i].count == STORED_READING;
+    }
+}
+
+// The log records up to the snapshot's sequence are now redundant
+void readings_flushed(const void* data_ptr) {
+    wal_snapshot_written(((const ReadingsTable*)data_ptr)->walSequence);
+}
+
+// Add a sensor for a topic matching one of TOPIC_PATTERNS, returns its slot or -1.
+// Runs on the ingest worker, which is the only thread that adds slots or uses the topic index.
+// A slot is added under dataMutex, other threads read the table under it too.
+int readings_discover(const char* topic) {
+    ReadingInfo info;
+    char room[CHAR_LEN];
+    if (topic_pattern_match(topic, &info.dataType, room, sizeof(room)) < 0 || room[0] == '\0') {
+        return -1;
+    }
+
+    if (numberOfReadings >= MAX_READINGS) {
+        static bool fullReported = false;
+        if (!fullReported) {
+            fullReported = true;
+            errorPublish("Sensor table full, new sensors are ignored");
+        }
+        return -1;
+    }
+
+    // Name the room after a known sensor in the same room, else after the topic segment
+    snprintf(info.description, CHAR_LEN, "%s", room);
+    info.description[0] = toupper((unsigned char)info.description[0]);
+    size_t roomLength = strlen(room);
+    for (int i = 0; i < numberOfReadings; i++) {
+        if (strncmp(readingInfo[i].topic, room, roomLength) == 0 && readingInfo[i].topic[roomLength] == '/') {
+            snprintf(info.description, CHAR_LEN, "%s", readingInfo[i].description);
+            break;
+        }
+    }
+    snprintf(info.topic, CHAR_LEN, "%s", topic);
+
+    int slot;
+    {
+        DataWriteGuard publish;
+        slot = numberOfReadings;
+        readings_add_slot(&info);
+        discovered.info[discovered.count++] = info;
+    }
+    topic_index_add(slot);
+    markDataDirty(STATE_SECTION_SENSORS);
+
+    char log_message[CHAR_LEN];
+    snprintf(log_message, CHAR_LEN, "New sensor %.200s found", topic);
+    logAndPublish(log_message);
+    return slot;
+}
+
+const char* reading_description(int index) {
+    return readingInfo[index].description;
+}
+
+const char* reading_topic(int index) {
+    return readingInfo[index].topic;
+}
+
+int reading_data_type(int index) {
+    return readingInfo[index].dataType;
+}
+
+// Copy the hot state of one slot between tables, used for the UI snapshot
+void copy_reading(ReadingsTable* dest, const ReadingsTable* src, int index) {
+    dest->currentValue[index] = src->currentValue[index];
+    dest->changeChar[index] = src->changeChar[index];
+    dest->enoughData[index] = src->enoughData[index];
+    dest->lastMessageTime[index] = src->lastMessageTime[index];
+    dest->generation[index] = src->generation[index];
+    memcpy(&dest->history[index], &src->history[index], sizeof(ReadingHistory));
+    memcpy(dest->output[index], src->output[index], sizeof(dest->output[index]));
+}
+
+// Add a sample to the window, evicting the oldest once full
+void history_add(ReadingHistory* history, float value) {
+    uint32_t slot = history->total % STORED_READING;
+
+    if (history->count == STORED_READING) {
+        history->sum -= history->samples[slot];
+    } else {
+        history->count++;
+    }
+    history->samples[slot] = value;
+    history->sum += value;
+    history->total++;
+
+    // Recompute the sum once per lap of the ring so rounding can't drift, still O(1) amortised
+    if (slot == STORED_READING - 1) {
+        history->sum = 0.0;
+        for (uint32_t i = 0; i < history->count; i++) {
+            history->sum += history->samples[i];
+        }
+    }
+}
+
+float history_mean(const ReadingHistory* history) {
+    if (history->count == 0) {
+        return 0.0;
+    }
+    return history->sum / history->count;
+}
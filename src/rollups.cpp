@@ -0,0 +1,184 @@
+#include "globals.h"
+
+// Minute, hour and day min/max/mean/count for every history series, updated as each sample
+// arrives so a question like today's lowest battery charge is a bucket lookup, not a scan.
+// Each resolution is a ring of buckets indexed by bucket number, a bucket is reset when a newer
+// period lands on it. Hours and days follow local time, so in a zone with a half hour offset the
+// hours of a day still add up to that day.
+typedef struct {
+    int64_t start; // Start of the period, 0 if empty
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+} RollupBucket;
+
+static const int rollupBuckets[ROLLUP_RESOLUTIONS] = {ROLLUP_MINUTE_BUCKETS, ROLLUP_HOUR_BUCKETS, ROLLUP_DAY_BUCKETS};
+static RollupBucket minuteBuckets[TS_MAX_SERIES][ROLLUP_MINUTE_BUCKETS];
+static RollupBucket hourBuckets[TS_MAX_SERIES][ROLLUP_HOUR_BUCKETS];
+static RollupBucket dayBuckets[TS_MAX_SERIES][ROLLUP_DAY_BUCKETS];
+static time_t lastSampleTime[TS_MAX_SERIES];
+static std::mutex rollupMutex;
+
+// Local hour containing the last lookup, its UTC offset only changes on an hour boundary
+static time_t cachedHourStart = 0;
+static time_t cachedHourEnd = 0;
+
+// Local day containing the last lookup, days are 23 or 25 hours long across DST changes
+static time_t cachedDayStart = 0;
+static time_t cachedDayEnd = 0;
+static int64_t cachedDayNumber = 0;
+
+static RollupBucket* rollup_ring(int series, int resolution) {
+    switch (resolution) {
+    case ROLLUP_MINUTE:
+        return minuteBuckets[series];
+    case ROLLUP_HOUR:
+        return hourBuckets[series];
+    default:
+        return dayBuckets[series];
+    }
+}
+
+// Start of the period containing time, and its number used to pick a bucket
+static time_t rollup_period(int resolution, time_t time, int64_t* number) {
+    switch (resolution) {
+    case ROLLUP_MINUTE:
+        *number = time / 60;
+        return time - time % 60;
+    case ROLLUP_HOUR:
+        if (time < cachedHourStart || time >= cachedHourEnd) {
+            struct tm local;
+            localtime_r(&time, &local);
+            cachedHourStart = time - (time + local.tm_gmtoff) % 3600;
+            cachedHourEnd = cachedHourStart + 3600;
+        }
+        // Numbered by start rather than local hour, so an hour repeated by DST gets its own bucket
+        *number = cachedHourStart / 3600;
+        return cachedHourStart;
+    default:
+        if (time < cachedDayStart || time >= cachedDayEnd) {
+            struct tm local;
+            localtime_r(&time, &local);
+            cachedDayNumber = (time + local.tm_gmtoff) / 86400;
+            local.tm_hour = 0;
+            local.tm_min = 0;
+            local.tm_sec = 0;
+            local.tm_isdst = -1;
+            cachedDayStart = mktime(&local);
+            local.tm_mday++;
+            local.tm_isdst = -1;
+            cachedDayEnd = mktime(&local);
+        }
+        *number = cachedDayNumber;
+        return cachedDayStart;
+    }
+}
+
+static void rollup_add_locked(int series, time_t time, float value) {
+    if (time <= lastSampleTime[series]) {
+        return; // Repeated or out of order sample, already counted
+    }
+    lastSampleTime[series] = time;
+
+    for (int resolution = 0; resolution < ROLLUP_RESOLUTIONS; resolution++) {
+        int64_t number;
+        time_t start = rollup_period(resolution, time, &number);
+        RollupBucket* bucket = &rollup_ring(series, resolution)[number % rollupBuckets[resolution]];
+        if (bucket->start != start) {
+            bucket->start = start;
+            bucket->min = value;
+            bucket->max = value;
+            bucket->sum = 0;
+            bucket->count = 0;
+        }
+        if (value < bucket->min) {
+            bucket->min = value;
+        }
+        if (value > bucket->max) {
+            bucket->max = value;
+        }
+        bucket->sum += value;
+        bucket->count++;
+    }
+}
+
+void rollup_add(int series, time_t time, float value) {
+    if (series < 0 || series >= TS_MAX_SERIES) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(rollupMutex);
+    rollup_add_locked(series, time, value);
+}
+
+// Store a sample in the history file and the rollups
+void record_sample(int series, time_t time, float value) {
+    ts_append(series, time, value);
+    rollup_add(series, time, value);
+}
+
+static bool rollup_rebuild_visit(time_t time, float value, void* context) {
+    rollup_add_locked(*(int*)context, time, value);
+    return true;
+}
+
+// Refill the rollups from the history file, so they carry on across restarts
+void rollups_init() {
+    std::lock_guard<std::mutex> lock(rollupMutex);
+    time_t now = time(NULL);
+    for (int series = 0; series < TS_MAX_SERIES; series++) {
+        ts_scan(series, now - (time_t)ROLLUP_DAY_BUCKETS * 86400, now, rollup_rebuild_visit, &series);
+    }
+}
+
+// Aggregate of the period containing time, false if nothing was recorded in it
+bool rollup_get(int series, int resolution, time_t time, RollupStats* stats) {
+    if (series < 0 || series >= TS_MAX_SERIES || resolution < 0 || resolution >= ROLLUP_RESOLUTIONS) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(rollupMutex);
+    int64_t number;
+    time_t start = rollup_period(resolution, time, &number);
+    const RollupBucket* bucket = &rollup_ring(series, resolution)[number % rollupBuckets[resolution]];
+    if (bucket->start != start || bucket->count == 0) {
+        return false;
+    }
+    stats->min = bucket->min;
+    stats->max = bucket->max;
+    stats->mean = bucket->sum / bucket->count;
+    stats->count = bucket->count;
+    return true;
+}
+
+// Aggregate of every period from the one containing from up to to, at most one ring of buckets
+bool rollup_range(int series, int resolution, time_t from, time_t to, RollupStats* stats) {
+    if (series < 0 || series >= TS_MAX_SERIES || resolution < 0 || resolution >= ROLLUP_RESOLUTIONS) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(rollupMutex);
+    int64_t number;
+    time_t first = rollup_period(resolution, from, &number);
+    const RollupBucket* ring = rollup_ring(series, resolution);
+    double sum = 0;
+    uint32_t count = 0;
+    for (int i = 0; i < rollupBuckets[resolution]; i++) {
+        const RollupBucket* bucket = &ring[i];
+        if (bucket->count == 0 || bucket->start < first || bucket->start > to) {
+            continue;
+        }
+        if (count == 0 || bucket->min < stats->min) {
+            stats->min = bucket->min;
+        }
+        if (count == 0 || bucket->max > stats->max) {
+            stats->max = bucket->max;
+        }
+        sum += bucket->sum;
+        count += bucket->count;
+    }
+    if (count == 0) {
+        return false;
+    }
+    stats->mean = sum / count;
+    stats->count = count;
+    return true;
+}
@@ -1,10 +1,30 @@
 #include "globals.h"
+#include <cerrno>
+#include <condition_variable>
+#include <fcntl.h>
 
 extern Solar solar;
 extern std::mutex dataMutex;
 static char dataDirectory[512] = {0};
 
-uint8_t calculateChecksum(const void* data_ptr, size_t size) {
+// Sections waiting to be written, writers only mark a section dirty and the persistence
+// thread writes it once PERSIST_MAX_LATENCY_SEC has passed, coalescing all changes in between
+typedef struct {
+    bool dirty;
+    time_t dirtySince;
+} PersistBlock;
+
+static PersistBlock persistBlocks[STATE_SECTION_COUNT];
+static std::mutex persistMutex;
+static std::condition_variable persistCV;
+static std::mutex persistWriteMutex; // Serialises the persistence thread and the shutdown flush
+
+// Persistence counters, reported by persistence_report_stats()
+static uint64_t persistMarks = 0;
+static uint64_t persistFlushes = 0;
+static uint64_t persistBytesWritten = 0;
+
+uint8_t calculateLegacyChecksum(const void* data_ptr, size_t size) {
     uint8_t sum = 0;
     const uint8_t* bytePtr = (const uint8_t*)data_ptr;
     for (size_t i = 0; i < size; ++i) {
@@ -13,7 +33,25 @@ uint8_t calculateChecksum(const void* data_ptr, size_t size) {
     return sum;
 }
 
-bool saveDataBlock(const char* filename, const void* data_ptr, size_t size) {
+// write() until everything is out, retrying short writes and interrupts
+static bool writeAll(int fd, const void* data_ptr, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data_ptr;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+// The file is written with mode, also when it replaces one that had other permissions
+bool saveDataBlock(const char* filename, const void* data_ptr, size_t size, mode_t mode) {
     char filepath[512];
     getDataFilePath(filename, filepath, sizeof(filepath));
 
@@ -34,12 +72,19 @@ bool saveDataBlock(const char* filename, const void* data_ptr, size_t size) {
 
     // Prepare header (no lock needed, working with local buffer)
     DataHeader header;
+    header.magic = DATA_FILE_MAGIC;
+    header.checksum = crc32c(buffer, size);
     header.size = size;
-    header.checksum = calculateChecksum(buffer, size);
 
-    // Open file and write (no lock needed - all I/O outside critical section)
-    FILE* dataFile = fopen(filepath, "wb");
-    if (!dataFile) {
+    // Write to a temporary file and rename it over the old one, so a power cut leaves
+    // either the previous complete file or the new one, never a truncated mix
+    char temppath[520];
+    snprintf(temppath, sizeof(temppath), "%s.tmp", filepath);
+    int fd = open(temppath, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0 || fchmod(fd, mode) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
         char log_message[CHAR_LEN];
         snprintf(log_message, sizeof(log_message), "Error opening file %s for writing", filename);
         logAndPublish(log_message);
@@ -47,32 +92,155 @@ bool saveDataBlock(const char* filename, const void* data_ptr, size_t size) {
         return false;
     }
 
-    // Write header
-    size_t headerWritten = fwrite(&header, 1, sizeof(DataHeader), dataFile);
-    if (headerWritten != sizeof(DataHeader)) {
+    bool written = writeAll(fd, &header, sizeof(DataHeader)) && writeAll(fd, buffer, size);
+    free(buffer);
+    if (!written) {
         char log_message[CHAR_LEN];
-        snprintf(log_message, sizeof(log_message), "Failed to write header to %s", filename);
+        snprintf(log_message, sizeof(log_message), "Failed to write all data to %s", filename);
         logAndPublish(log_message);
-        fclose(dataFile);
-        free(buffer);
+        close(fd);
+        unlink(temppath);
         return false;
     }
 
-    // Write data from buffer
-    size_t bytesWritten = fwrite(buffer, 1, size, dataFile);
-    fclose(dataFile);
-    free(buffer);
+    // Data must be on the card before the rename makes it visible
+    if (fsync(fd) != 0) {
+        char log_message[CHAR_LEN];
+        snprintf(log_message, sizeof(log_message), "Failed to sync %s", filename);
+        logAndPublish(log_message);
+        close(fd);
+        unlink(temppath);
+        return false;
+    }
+    close(fd);
 
-    if (bytesWritten != size) {
+    if (rename(temppath, filepath) != 0) {
         char log_message[CHAR_LEN];
-        snprintf(log_message, sizeof(log_message), "Failed to write all data to %s. Wrote %zu of %zu bytes", filename, bytesWritten, size);
+        snprintf(log_message, sizeof(log_message), "Failed to replace %s", filename);
         logAndPublish(log_message);
+        unlink(temppath);
         return false;
     }
 
+    syncDataDirectory();
     return true;
 }
 
+// Make a rename in the data directory durable
+void syncDataDirectory() {
+    int dirfd = open(dataDirectory, O_RDONLY | O_DIRECTORY);
+    if (dirfd >= 0) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+}
+
+void markDataDirty(int section) {
+    std::lock_guard<std::mutex> lock(persistMutex);
+    persistMarks++;
+    PersistBlock* block = &persistBlocks[section];
+    if (!block->dirty) {
+        block->dirty = true;
+        block->dirtySince = time(NULL);
+        persistCV.notify_one();
+    }
+}
+
+// Once any dirty section is due write every dirty section, so they share one header update.
+// With force everything dirty is written straight away.
+static void persistence_write_due(bool force) {
+    bool due[STATE_SECTION_COUNT] = {false};
+    int numberDue = 0;
+    time_t now = time(NULL);
+
+    std::lock_guard<std::mutex> writeLock(persistWriteMutex);
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        bool anyDue = force;
+        for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+            if (persistBlocks[i].dirty && now - persistBlocks[i].dirtySince >= PERSIST_MAX_LATENCY_SEC) {
+                anyDue = true;
+            }
+        }
+        for (int i = 0; anyDue && i < STATE_SECTION_COUNT; i++) {
+            if (persistBlocks[i].dirty) {
+                persistBlocks[i].dirty = false;
+                due[i] = true;
+                numberDue++;
+            }
+        }
+    }
+    if (numberDue == 0) {
+        return;
+    }
+
+    long bytesWritten = state_flush(due);
+    if (bytesWritten >= 0) {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        persistFlushes += numberDue;
+        persistBytesWritten += bytesWritten;
+    } else {
+        // Try again next window
+        for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+            if (due[i]) {
+                markDataDirty(i);
+            }
+        }
+    }
+}
+
+// Wake the persistence thread to look again at what is due, used by the readings log
+void persistence_wake() {
+    std::lock_guard<std::mutex> lock(persistMutex);
+    persistCV.notify_one();
+}
+
+void* persistence_t(void* pvParameters) {
+    (void)pvParameters;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(persistMutex);
+            // Sleep until the oldest dirty block or the readings log sync is due, or until something changes
+            time_t due = wal_sync_due();
+            for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+                if (persistBlocks[i].dirty && (due == 0 || persistBlocks[i].dirtySince + PERSIST_MAX_LATENCY_SEC < due)) {
+                    due = persistBlocks[i].dirtySince + PERSIST_MAX_LATENCY_SEC;
+                }
+            }
+            if (due == 0) {
+                persistCV.wait(lock);
+                continue;
+            }
+            time_t wait_s = due - time(NULL);
+            if (wait_s > 0) {
+                persistCV.wait_for(lock, std::chrono::seconds(wait_s));
+                continue;
+            }
+        }
+        wal_sync(false);
+        persistence_write_due(false);
+    }
+    return NULL;
+}
+
+void persistence_flush() {
+    wal_sync(true);
+    persistence_write_due(true);
+}
+
+void persistence_report_stats() {
+    char stats_message[CHAR_LEN];
+    {
+        std::lock_guard<std::mutex> lock(persistMutex);
+        snprintf(stats_message, CHAR_LEN, "Persistence %llu flushes, %llu bytes written, %llu changes coalesced", (unsigned long long)persistFlushes,
+                 (unsigned long long)persistBytesWritten, (unsigned long long)(persistMarks > persistFlushes ? persistMarks - persistFlushes : 0));
+        persistMarks = 0;
+        persistFlushes = 0;
+        persistBytesWritten = 0;
+    }
+    statsPublish(stats_message);
+}
+
 bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size) {
    char filepath[512];
     getDataFilePath(filename, filepath, sizeof(filepath));
@@ -86,9 +254,18 @@ bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size) {
         return false;
     }
 
-    // 1. Read the header
+    // 1. Read the header, files written before CRC32C have the legacy header
     DataHeader header;
+    bool legacy = false;
     size_t headerRead = fread(&header, 1, sizeof(DataHeader), dataFile);
+    if (headerRead >= sizeof(uint32_t) && header.magic != DATA_FILE_MAGIC) {
+        LegacyDataHeader legacyHeader;
+        rewind(dataFile);
+        headerRead = fread(&legacyHeader, 1, sizeof(LegacyDataHeader), dataFile) == sizeof(LegacyDataHeader) ? sizeof(DataHeader) : 0;
+        header.size = legacyHeader.size;
+        header.checksum = legacyHeader.checksum;
+        legacy = true;
+    }
 
     if (headerRead != sizeof(DataHeader)) {
         char log_message[CHAR_LEN];
@@ -129,11 +306,11 @@ bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size) {
     }
 
     // 4. Verify checksum (working with local buffer, no lock needed)
-    uint8_t calculated = calculateChecksum(buffer, expected_size);
+    uint32_t calculated = legacy ? calculateLegacyChecksum(buffer, expected_size) : crc32c(buffer, expected_size);
 
     if (header.checksum != calculated) {
         char log_message[CHAR_LEN];
-        snprintf(log_message, sizeof(log_message), "Checksum failed for %s! Stored: 0x%02X, Calculated: 0x%02X", filename, header.checksum, calculated);
+        snprintf(log_message, sizeof(log_message), "Checksum failed for %s! Stored: 0x%08X, Calculated: 0x%08X", filename, header.checksum, calculated);
         logAndPublish(log_message);
         free(buffer);
         return false;
@@ -141,7 +318,7 @@ bool loadDataBlock(const char* filename, void* data_ptr, size_t expected_size) {
 
     // 5. Copy validated data to destination under lock (fast operation)
     {
-        std::lock_guard<std::mutex> lock(dataMutex);
+        DataWriteGuard publish;
         memcpy(data_ptr, buffer, expected_size);
     }
 
@@ -0,0 +1,182 @@
+#include "globals.h"
+#include <cstddef>
+
+// Field tables for every persisted struct. Each section is written with its table in front,
+// so a later build can find fields by tag even after they move, grow, shrink or change type.
+// Tags are stable: never reuse or renumber one, give new fields the next free tag.
+#define FIELD(tag, type, structType, member) {tag, type, 0, (uint32_t)offsetof(structType, member), (uint32_t)sizeof(((structType*)0)->member), 1, 1, 0}
+#define FIELD_ARRAY(tag, type, structType, member, count)                                                                                                            \
+    {tag, type, 0, (uint32_t)offsetof(structType, member), (uint32_t)sizeof(((structType*)0)->member[0]), count, 1, 0}
+
+static const FieldDescriptor solarFields[] = {
+    FIELD(1, FIELD_INT, Solar, currentUpdateTime),
+    FIELD(2, FIELD_INT, Solar, dailyUpdateTime),
+    FIELD(3, FIELD_INT, Solar, monthlyUpdateTime),
+    FIELD(4, FIELD_FLOAT, Solar, batteryCharge),
+    FIELD(5, FIELD_FLOAT, Solar, usingPower),
+    FIELD(6, FIELD_FLOAT, Solar, gridPower),
+    FIELD(7, FIELD_FLOAT, Solar, batteryPower),
+    FIELD(8, FIELD_FLOAT, Solar, solarPower),
+    FIELD(9, FIELD_STRING, Solar, time),
+    // 10 to 12 held the old battery min/max, now from the rollups
+    FIELD(13, FIELD_FLOAT, Solar, today_buy),
+    FIELD(14, FIELD_FLOAT, Solar, month_buy),
+    FIELD(15, FIELD_UINT, Solar, generation),
+};
+
+static const FieldDescriptor weatherFields[] = {
+    FIELD(1, FIELD_FLOAT, Weather, temperature),
+    FIELD(2, FIELD_FLOAT, Weather, windSpeed),
+    FIELD(3, FIELD_FLOAT, Weather, maxTemp),
+    FIELD(4, FIELD_FLOAT, Weather, minTemp),
+    FIELD(5, FIELD_UINT, Weather, isDay),
+    FIELD(6, FIELD_INT, Weather, updateTime),
+    FIELD(7, FIELD_STRING, Weather, windDir),
+    FIELD(8, FIELD_STRING, Weather, description),
+    FIELD(9, FIELD_STRING, Weather, time_string),
+    FIELD(10, FIELD_UINT, Weather, generation),
+};
+
+static const FieldDescriptor uvFields[] = {
+    FIELD(1, FIELD_INT, UV, index),
+    FIELD(2, FIELD_INT, UV, updateTime),
+    FIELD(3, FIELD_STRING, UV, time_string),
+    FIELD(4, FIELD_UINT, UV, generation),
+    FIELD_ARRAY(5, FIELD_FLOAT, UV, hourly, UV_HOURS),
+};
+
+// History is kept whole, its ring and sum only make sense together, so it is dropped and
+// rebuilt if STORED_READING or its layout changes
+static const FieldDescriptor readingsFields[] = {
+    FIELD_ARRAY(1, FIELD_FLOAT, ReadingsTable, currentValue, MAX_READINGS),
+    FIELD_ARRAY(2, FIELD_UINT, ReadingsTable, changeChar, MAX_READINGS),
+    FIELD_ARRAY(3, FIELD_UINT, ReadingsTable, enoughData, MAX_READINGS),
+    FIELD_ARRAY(4, FIELD_INT, ReadingsTable, lastMessageTime, MAX_READINGS),
+    FIELD_ARRAY(5, FIELD_UINT, ReadingsTable, generation, MAX_READINGS),
+    FIELD_ARRAY(6, FIELD_OPAQUE, ReadingsTable, history, MAX_READINGS),
+    {7, FIELD_STRING, 0, (uint32_t)offsetof(ReadingsTable, output), READING_OUTPUT_LEN, 1, MAX_READINGS, READING_OUTPUT_LEN},
+    FIELD(8, FIELD_UINT, ReadingsTable, walSequence),
+};
+
+static const FieldDescriptor sensorsFields[] = {
+    FIELD(1, FIELD_INT, DiscoveredSensors, count),
+    {2, FIELD_STRING, 0, (uint32_t)offsetof(DiscoveredSensors, info[0].description), CHAR_LEN, 1, MAX_READINGS, sizeof(ReadingInfo)},
+    {3, FIELD_STRING, 0, (uint32_t)offsetof(DiscoveredSensors, info[0].topic), CHAR_LEN, 1, MAX_READINGS, sizeof(ReadingInfo)},
+    {4, FIELD_INT, 0, (uint32_t)offsetof(DiscoveredSensors, info[0].dataType), sizeof(int), 1, MAX_READINGS, sizeof(ReadingInfo)},
+};
+
+static const FieldDescriptor* sectionFields[STATE_SECTION_COUNT] = {solarFields, weatherFields, uvFields, readingsFields, sensorsFields};
+static const int sectionFieldCount[STATE_SECTION_COUNT] = {
+    sizeof(solarFields) / sizeof(solarFields[0]),    sizeof(weatherFields) / sizeof(weatherFields[0]), sizeof(uvFields) / sizeof(uvFields[0]),
+    sizeof(readingsFields) / sizeof(readingsFields[0]), sizeof(sensorsFields) / sizeof(sensorsFields[0]),
+};
+
+const FieldDescriptor* schema_fields(int section, int* count) {
+    *count = sectionFieldCount[section];
+    return sectionFields[section];
+}
+
+// Read one integer or float element of any stored width
+static bool schema_read_number(const uint8_t* src, const FieldDescriptor* field, int64_t* asInt, double* asFloat) {
+    switch (field->type) {
+    case FIELD_INT:
+    case FIELD_UINT: {
+        if (field->elementSize != 1 && field->elementSize != 2 && field->elementSize != 4 && field->elementSize != 8) {
+            return false;
+        }
+        uint64_t raw = 0;
+        memcpy(&raw, src, field->elementSize);
+        if (field->type == FIELD_INT && field->elementSize < 8 && (raw >> (field->elementSize * 8 - 1)) & 1) {
+            raw |= ~0ULL << (field->elementSize * 8); // Sign extend
+        }
+        *asInt = (int64_t)raw;
+        *asFloat = field->type == FIELD_INT ? (double)*asInt : (double)raw;
+        return true;
+    }
+    case FIELD_FLOAT:
+        if (field->elementSize == sizeof(float)) {
+            float value;
+            memcpy(&value, src, sizeof(value));
+            *asFloat = value;
+        } else if (field->elementSize == sizeof(double)) {
+            memcpy(asFloat, src, sizeof(double));
+        } else {
+            return false;
+        }
+        *asInt = (int64_t)*asFloat;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void schema_write_number(uint8_t* dst, const FieldDescriptor* field, int64_t asInt, double asFloat) {
+    if (field->type == FIELD_FLOAT) {
+        if (field->elementSize == sizeof(float)) {
+            float value = (float)asFloat;
+            memcpy(dst, &value, sizeof(value));
+        } else {
+            memcpy(dst, &asFloat, sizeof(double));
+        }
+    } else {
+        memcpy(dst, &asInt, field->elementSize); // Little endian, the low bytes hold the value
+    }
+}
+
+static void schema_copy_element(uint8_t* dst, const FieldDescriptor* to, const uint8_t* src, const FieldDescriptor* from) {
+    if (to->type == FIELD_STRING || from->type == FIELD_STRING) {
+        if (to->type == FIELD_STRING && from->type == FIELD_STRING) {
+            size_t length = strnlen((const char*)src, from->elementSize);
+            if (length >= to->elementSize) {
+                length = to->elementSize - 1;
+            }
+            memcpy(dst, src, length);
+            memset(dst + length, 0, to->elementSize - length);
+        }
+        return;
+    }
+    if (to->type == FIELD_OPAQUE || from->type == FIELD_OPAQUE) {
+        if (to->type == from->type && to->elementSize == from->elementSize) {
+            memcpy(dst, src, to->elementSize);
+        }
+        return;
+    }
+    int64_t asInt;
+    double asFloat;
+    if (schema_read_number(src, from, &asInt, &asFloat)) {
+        schema_write_number(dst, to, asInt, asFloat);
+    }
+}
+
+// Copy every field present in both tables from src into dst, converting width and type where
+// needed. Fields only in dst keep their current value, fields only in src are dropped.
+void schema_migrate(int section, void* dst, size_t dstSize, const FieldDescriptor* srcFields, int srcCount, const void* src, size_t srcSize) {
+    int count;
+    const FieldDescriptor* fields = schema_fields(section, &count);
+    for (int i = 0; i < count; i++) {
+        const FieldDescriptor* to = &fields[i];
+        const FieldDescriptor* from = NULL;
+        for (int j = 0; j < srcCount; j++) {
+            if (srcFields[j].tag == to->tag) {
+                from = &srcFields[j];
+                break;
+            }
+        }
+        if (!from) {
+            continue;
+        }
+
+        uint32_t outer = to->outerCount < from->outerCount ? to->outerCount : from->outerCount;
+        uint32_t inner = to->count < from->count ? to->count : from->count;
+        for (uint32_t o = 0; o < outer; o++) {
+            for (uint32_t n = 0; n < inner; n++) {
+                size_t srcOffset = from->offset + (size_t)o * from->outerStride + (size_t)n * from->elementSize;
+                size_t dstOffset = to->offset + (size_t)o * to->outerStride + (size_t)n * to->elementSize;
+                if (srcOffset + from->elementSize > srcSize || dstOffset + to->elementSize > dstSize) {
+                    continue; // Descriptor outside its data, ignore rather than trust it
+                }
+                schema_copy_element((uint8_t*)dst + dstOffset, to, (const uint8_t*)src + srcOffset, from);
+            }
+        }
+    }
+}
@@ -0,0 +1,429 @@
+#include "globals.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+extern Solar solar;
+extern Weather weather;
+extern UV uv;
+extern ReadingsTable readings;
+extern DiscoveredSensors discovered;
+extern std::mutex dataMutex;
+
+// All persisted state lives in one memory mapped file. Pages 0 and 1 each hold a copy of the
+// StateHeader, each section has two page aligned copies after them. A flush writes the inactive
+// copy of a section, msyncs only the pages that changed, then writes and syncs only the page of
+// the older header copy, so a power cut at any point, even one that tears that page, leaves the
+// previous state intact.
+//
+// Each copy starts with the section's field table (schema.cpp). When it matches this build the
+// data is restored with one memcpy, otherwise fields are migrated by tag. If the section sizes
+// change the old file is kept as STATE_FILENAME.old until every section has been rewritten.
+typedef struct {
+    const char* name;
+    const char* legacyFilename; // Separate file used before the state store, imported once
+    void* data_ptr;
+    size_t size;
+    void (*migrated)();                    // Called after a restore that needed migration, may be NULL
+    void (*flushed)(const void* data_ptr); // Called with the written data once it is in the map, may be NULL
+} StateSectionInfo;
+
+static StateSectionInfo sectionInfo[STATE_SECTION_COUNT] = {
+    {"Solar", SOLAR_DATA_FILENAME, &solar, sizeof(solar), NULL, NULL},
+    {"Weather", WEATHER_DATA_FILENAME, &weather, sizeof(weather), NULL, NULL},
+    {"UV", UV_DATA_FILENAME, &uv, sizeof(uv), NULL, NULL},
+    {"Readings", READINGS_DATA_FILENAME, &readings, sizeof(readings), readings_migrated, readings_flushed},
+    {"Sensors", SENSORS_DATA_FILENAME, &discovered, sizeof(discovered), NULL, NULL},
+};
+
+typedef struct {
+    uint8_t* map;
+    size_t mapSize;
+    StateHeader header; // Copy of the newest valid header
+} StateFile;
+
+static StateFile current = {NULL, 0, {}};
+static StateFile previous = {NULL, 0, {}}; // Old layout being migrated from, read only
+static bool fromPrevious[STATE_SECTION_COUNT];
+static size_t statePageSize = 0;
+static uint32_t copySize[STATE_SECTION_COUNT];      // Schema plus data
+static uint8_t* sectionBuffer[STATE_SECTION_COUNT]; // Copy image built before writing
+
+static size_t state_round_pages(size_t size) {
+    return (size + statePageSize - 1) / statePageSize * statePageSize;
+}
+
+static uint32_t state_header_checksum(const StateHeader* header) {
+    return crc32c(header, offsetof(StateHeader, checksum));
+}
+
+static uint32_t state_data_offset(int fieldCount) {
+    return (sizeof(SchemaPrefix) + fieldCount * sizeof(FieldDescriptor) + 7) & ~7u;
+}
+
+// Offsets follow from the section sizes, a file laid out differently is migrated
+static size_t state_layout(StateHeader* header) {
+    memset(header, 0, sizeof(StateHeader));
+    header->magic = STATE_FILE_MAGIC;
+    header->version = STATE_VERSION;
+    header->pageSize = statePageSize;
+    header->sectionCount = STATE_SECTION_COUNT;
+
+    size_t offset = 2 * statePageSize;
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        int fieldCount;
+        schema_fields(i, &fieldCount);
+        copySize[i] = state_data_offset(fieldCount) + sectionInfo[i].size;
+        for (int copy = 0; copy < 2; copy++) {
+            header->sections[i].offset[copy] = offset;
+            offset += state_round_pages(copySize[i]);
+        }
+    }
+    return offset;
+}
+
+static bool state_header_valid(const StateHeader* header, size_t mapSize) {
+    if (header->magic != STATE_FILE_MAGIC || (header->version != STATE_VERSION && header->version != STATE_VERSION_SHARED_HEADER_PAGE) || header->pageSize != statePageSize || header->sectionCount > STATE_MAX_SECTIONS) {
+        return false;
+    }
+    if (header->checksum != state_header_checksum(header)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->sectionCount; i++) {
+        const StateSection* section = &header->sections[i];
+        if (section->offset[0] + section->size > mapSize || section->offset[1] + section->size > mapSize) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool state_same_layout(const StateHeader* a, const StateHeader* b) {
+    if (a->sectionCount != b->sectionCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < a->sectionCount; i++) {
+        if (a->sections[i].offset[0] != b->sections[i].offset[0] || a->sections[i].offset[1] != b->sections[i].offset[1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Map a state file and find its newest valid header, false if it is missing or has none
+static bool state_map_existing(const char* filepath, int flags, StateFile* file) {
+    int fd = open(filepath, flags);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < 2 * statePageSize) {
+        close(fd);
+        return false;
+    }
+    int protection = (flags & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* map = mmap(NULL, st.st_size, protection, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // A copy at the start of page 0 or 1, or the second copy of an older file just after the first
+    const size_t offsets[3] = {0, statePageSize, sizeof(StateHeader)};
+    const StateHeader* newest = NULL;
+    for (int n = 0; n < 3; n++) {
+        const StateHeader* copy = (const StateHeader*)((const uint8_t*)map + offsets[n]);
+        bool placed = n == 0 || copy->version == (n == 1 ? STATE_VERSION : STATE_VERSION_SHARED_HEADER_PAGE);
+        if (placed && state_header_valid(copy, st.st_size) && (!newest || copy->sequence > newest->sequence)) {
+            newest = copy;
+        }
+    }
+    if (!newest) {
+        munmap(map, st.st_size);
+        return false;
+    }
+    file->map = (uint8_t*)map;
+    file->mapSize = st.st_size;
+    file->header = *newest;
+    return true;
+}
+
+bool state_open() {
+    statePageSize = sysconf(_SC_PAGESIZE);
+    static_assert(2 * sizeof(StateHeader) <= 4096, "A state header must fit in a page, and two in the first page of older files");
+
+    StateHeader layout;
+    size_t layoutSize = state_layout(&layout);
+
+    char filepath[512];
+    char oldpath[520];
+    getDataFilePath(STATE_FILENAME, filepath, sizeof(filepath));
+    snprintf(oldpath, sizeof(oldpath), "%s.old", filepath);
+
+    // Keep using the file in place if its layout still matches this build
+    if (state_map_existing(filepath, O_RDWR, &current) && !state_same_layout(&current.header, &layout)) {
+        munmap(current.map, current.mapSize);
+        current.map = NULL;
+        if (rename(filepath, oldpath) != 0) {
+            logAndPublish("Failed to move old state file aside");
+        }
+    }
+    if (state_map_existing(oldpath, O_RDONLY, &previous)) {
+        logAndPublish("State layout changed, migrating");
+    }
+
+    if (!current.map) {
+        int fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            logAndPublish("Error opening state file");
+            return false;
+        }
+        if (ftruncate(fd, layoutSize) != 0) {
+            logAndPublish("Error sizing state file");
+            close(fd);
+            return false;
+        }
+        void* map = mmap(NULL, layoutSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            logAndPublish("Error mapping state file");
+            return false;
+        }
+        current.map = (uint8_t*)map;
+        current.mapSize = layoutSize;
+        current.header = layout;
+        if (previous.map) {
+            current.header.sequence = previous.header.sequence;
+        }
+    }
+
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        sectionBuffer[i] = (uint8_t*)malloc(copySize[i]);
+        if (!sectionBuffer[i]) {
+            logAndPublish("Failed to allocate state buffers");
+            munmap(current.map, current.mapSize);
+            current.map = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Restore a section from one copy, with a memcpy if its schema matches this build
+static bool state_decode(int section, const StateFile* file) {
+    const StateSectionInfo* info = &sectionInfo[section];
+    if ((uint32_t)section >= file->header.sectionCount) {
+        return false;
+    }
+    const StateSection* stored = &file->header.sections[section];
+    const uint8_t* copy = file->map + stored->offset[stored->active];
+    if (stored->generation == 0 || stored->size < sizeof(SchemaPrefix) || stored->checksum != crc32c(copy, stored->size)) {
+        return false;
+    }
+
+    SchemaPrefix prefix;
+    memcpy(&prefix, copy, sizeof(prefix));
+    if (prefix.dataOffset < sizeof(SchemaPrefix) + (uint64_t)prefix.fieldCount * sizeof(FieldDescriptor) || (uint64_t)prefix.dataOffset + prefix.dataSize > stored->size) {
+        return false;
+    }
+    const FieldDescriptor* storedFields = (const FieldDescriptor*)(copy + sizeof(SchemaPrefix));
+    const uint8_t* data = copy + prefix.dataOffset;
+
+    int fieldCount;
+    const FieldDescriptor* fields = schema_fields(section, &fieldCount);
+    if (prefix.fieldCount == (uint32_t)fieldCount && prefix.dataSize == info->size && memcmp(storedFields, fields, fieldCount * sizeof(FieldDescriptor)) == 0) {
+        DataWriteGuard publish;
+        memcpy(info->data_ptr, data, info->size);
+        return true;
+    }
+
+    // Layout changed, migrate field by field into a copy of the current state
+    uint8_t* scratch = sectionBuffer[section];
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        memcpy(scratch, info->data_ptr, info->size);
+    }
+    schema_migrate(section, scratch, info->size, storedFields, prefix.fieldCount, data, prefix.dataSize);
+    {
+        DataWriteGuard publish;
+        memcpy(info->data_ptr, scratch, info->size);
+    }
+    if (info->migrated) {
+        info->migrated();
+    }
+
+    char log_message[CHAR_LEN];
+    snprintf(log_message, CHAR_LEN, "%s state migrated to the current layout", info->name);
+    logAndPublish(log_message);
+    markDataDirty(section);
+    return true;
+}
+
+// Copy a section out of the map, falling back to the old layout or its legacy file
+bool state_restore(int section) {
+    const StateSectionInfo* info = &sectionInfo[section];
+    if (current.map && state_decode(section, &current)) {
+        return true;
+    }
+    if (previous.map && state_decode(section, &previous)) {
+        fromPrevious[section] = true;
+        markDataDirty(section);
+        return true;
+    }
+
+    if (loadDataBlock(info->legacyFilename, info->data_ptr, info->size)) {
+        char log_message[CHAR_LEN];
+        snprintf(log_message, CHAR_LEN, "%s state imported from %s", info->name, info->legacyFilename);
+        logAndPublish(log_message);
+        markDataDirty(section);
+        return true;
+    }
+    return false;
+}
+
+// Write a section's new copy, returns the bytes written or -1 on failure. The header still
+// points at the old copy until state_flush() writes it.
+static long state_write_section(int section) {
+    const StateSectionInfo* info = &sectionInfo[section];
+    uint8_t* image = sectionBuffer[section];
+    int fieldCount;
+    const FieldDescriptor* fields = schema_fields(section, &fieldCount);
+
+    SchemaPrefix prefix = {(uint32_t)fieldCount, state_data_offset(fieldCount), (uint32_t)info->size, 0};
+    memset(image, 0, prefix.dataOffset);
+    memcpy(image, &prefix, sizeof(prefix));
+    memcpy(image + sizeof(prefix), fields, fieldCount * sizeof(FieldDescriptor));
+    {
+        std::lock_guard<std::mutex> lock(dataMutex);
+        memcpy(image + prefix.dataOffset, info->data_ptr, info->size);
+    }
+
+    // Only touch pages that differ from the copy being replaced
+    StateSection* stored = &current.header.sections[section];
+    int target = stored->generation > 0 ? 1 - stored->active : stored->active;
+    uint8_t* destination = current.map + stored->offset[target];
+    long bytesWritten = 0;
+    for (size_t page = 0; page < copySize[section]; page += statePageSize) {
+        size_t length = copySize[section] - page < statePageSize ? copySize[section] - page : statePageSize;
+        if (memcmp(destination + page, image + page, length) != 0) {
+            memcpy(destination + page, image + page, length);
+            if (msync(destination + page, statePageSize, MS_SYNC) != 0) {
+                logAndPublish("Failed to sync state file");
+                return -1;
+            }
+            bytesWritten += statePageSize;
+        }
+    }
+
+    stored->checksum = crc32c(image, copySize[section]);
+    stored->size = copySize[section];
+    stored->generation++;
+    stored->active = target;
+    return bytesWritten;
+}
+
+// Drop the old layout once every section restored from it has been rewritten
+static void state_release_previous() {
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        if (fromPrevious[i]) {
+            return;
+        }
+    }
+    char filepath[512];
+    char oldpath[520];
+    getDataFilePath(STATE_FILENAME, filepath, sizeof(filepath));
+    snprintf(oldpath, sizeof(oldpath), "%s.old", filepath);
+    munmap(previous.map, previous.mapSize);
+    previous.map = NULL;
+    unlink(oldpath);
+    logAndPublish("State migration complete");
+}
+
+// Write the sections flagged in due, then one header update covering all of them.
+// Returns the bytes written or -1 if nothing could be saved.
+long state_flush(const bool* due) {
+    if (!current.map) {
+        long bytesWritten = 0;
+        for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+            const StateSectionInfo* info = &sectionInfo[i];
+            if (!due[i]) {
+                continue;
+            }
+            if (!info->flushed) {
+                if (!saveDataBlock(info->legacyFilename, info->data_ptr, info->size, 0644)) {
+                    return -1;
+                }
+                bytesWritten += sizeof(DataHeader) + info->size;
+                continue;
+            }
+            // The hook needs the data as written, the live copy may already have moved on
+            void* copy = malloc(info->size);
+            if (!copy) {
+                logAndPublish("Failed to allocate state buffers");
+                return -1;
+            }
+            {
+                std::lock_guard<std::mutex> lock(dataMutex);
+                memcpy(copy, info->data_ptr, info->size);
+            }
+            bool saved = saveDataBlock(info->legacyFilename, copy, info->size, 0644);
+            if (saved) {
+                info->flushed(copy);
+            }
+            free(copy);
+            if (!saved) {
+                return -1;
+            }
+            bytesWritten += sizeof(DataHeader) + info->size;
+        }
+        return bytesWritten;
+    }
+
+    // A section that fails keeps its old header entry, so the others can still be published
+    StateHeader before = current.header;
+    long bytesWritten = 0;
+    bool written = false;
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        if (due[i]) {
+            long sectionBytes = state_write_section(i);
+            if (sectionBytes < 0) {
+                current.header.sections[i] = before.sections[i];
+                continue;
+            }
+            bytesWritten += sectionBytes;
+            written = true;
+        }
+    }
+    if (!written) {
+        return -1;
+    }
+
+    // Write the header over its older copy, the other copy's page is not touched
+    current.header.version = STATE_VERSION;
+    current.header.sequence++;
+    current.header.checksum = state_header_checksum(&current.header);
+    uint8_t* headerPage = current.map + (current.header.sequence % 2) * statePageSize;
+    memcpy(headerPage, &current.header, sizeof(StateHeader));
+    if (msync(headerPage, statePageSize, MS_SYNC) != 0) {
+        logAndPublish("Failed to sync state file header");
+        current.header = before;
+        return -1;
+    }
+
+    for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+        if (due[i] && sectionInfo[i].flushed && current.header.sections[i].generation != before.sections[i].generation) {
+            int fieldCount;
+            schema_fields(i, &fieldCount);
+            sectionInfo[i].flushed(sectionBuffer[i] + state_data_offset(fieldCount));
+        }
+    }
+
+    if (previous.map) {
+        for (int i = 0; i < STATE_SECTION_COUNT; i++) {
+            if (due[i] && current.header.sections[i].generation != before.sections[i].generation) {
+                fromPrevious[i] = false;
+            }
+        }
+        state_release_previous();
+    }
+    return bytesWritten + statePageSize;
+}
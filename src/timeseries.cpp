@@ -0,0 +1,395 @@
+#include "globals.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+
+// Long term history of every reading slot and the solar values, in a memory mapped file of
+// fixed size blocks used as a ring, the oldest block is reused once the file is full. Each block
+// holds one series, compressed as in Facebook's Gorilla: timestamps as delta-of-delta and values
+// XORed with the previous one, so a slowly changing sensor costs a few bits per sample.
+// Block 0 holds the file header.
+typedef struct {
+    uint32_t magic;   // TS_FILE_MAGIC
+    uint32_t version; // TS_VERSION
+    uint32_t blockSize;
+    uint32_t blockCount;
+} TsFileHeader;
+
+typedef struct {
+    uint32_t magic;     // TS_BLOCK_MAGIC once the block is in use
+    uint16_t series;
+    uint16_t reserved;
+    uint32_t sequence;  // Order blocks were opened in, increases around the ring
+    uint32_t count;     // Samples in the block
+    uint32_t bitLength; // Bits of compressed data after the header
+    uint32_t reserved2;
+    int64_t firstTime;
+    int64_t lastTime;
+} TsBlockHeader;
+
+#define TS_DATA_BITS ((TS_BLOCK_SIZE - sizeof(TsBlockHeader)) * 8)
+#define TS_MAX_SAMPLE_BITS 80 // Worst case for one sample, 4 + 32 timestamp and 2 + 10 + 32 value
+
+// Encoder state of the open block of one series, also rebuilt by decoding when resuming
+typedef struct {
+    int block; // Open block, 0 if none
+    int64_t time;
+    int64_t delta;
+    uint32_t value;
+    int leading; // Window of meaningful bits of the last XOR, leading < 0 if none yet
+    int trailing;
+} TsCursor;
+
+static uint8_t* tsMap = NULL;
+static std::mutex tsMutex;
+static TsCursor cursors[TS_MAX_SERIES];
+static int nextBlock = 1;
+static uint32_t nextSequence = 1;
+
+// Store counters, reported by ts_report_stats()
+static uint64_t tsSamples = 0;
+static uint64_t tsBlocksUsed = 0;
+
+static TsBlockHeader* ts_block(int block) {
+    return (TsBlockHeader*)(tsMap + (size_t)block * TS_BLOCK_SIZE);
+}
+
+static uint8_t* ts_block_data(int block) {
+    return tsMap + (size_t)block * TS_BLOCK_SIZE + sizeof(TsBlockHeader);
+}
+
+static void ts_write_bits(uint8_t* data, uint32_t* bitLength, uint64_t value, int bits) {
+    for (int bit = bits - 1; bit >= 0; bit--) {
+        uint32_t position = (*bitLength)++;
+        if ((value >> bit) & 1) {
+            data[position >> 3] |= 0x80 >> (position & 7);
+        } else {
+            data[position >> 3] &= ~(0x80 >> (position & 7));
+        }
+    }
+}
+
+static uint64_t ts_read_bits(const uint8_t* data, uint32_t* position, int bits) {
+    uint64_t value = 0;
+    for (int bit = 0; bit < bits; bit++) {
+        value = (value << 1) | ((data[*position >> 3] >> (7 - (*position & 7))) & 1);
+        (*position)++;
+    }
+    return value;
+}
+
+static uint32_t ts_float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float ts_bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Append one sample to the block's bit stream and advance the cursor
+static void ts_encode(TsCursor* cursor, uint8_t* data, uint32_t* bitLength, uint32_t count, int64_t time, uint32_t value) {
+    if (count == 0) {
+        ts_write_bits(data, bitLength, (uint64_t)time, 64);
+        ts_write_bits(data, bitLength, value, 32);
+        cursor->time = time;
+        cursor->delta = 0;
+        cursor->value = value;
+        cursor->leading = -1;
+        return;
+    }
+
+    int64_t delta = time - cursor->time;
+    int64_t deltaOfDelta = delta - cursor->delta;
+    if (deltaOfDelta == 0) {
+        ts_write_bits(data, bitLength, 0, 1);
+    } else if (deltaOfDelta >= -63 && deltaOfDelta <= 64) {
+        ts_write_bits(data, bitLength, 0x2, 2);
+        ts_write_bits(data, bitLength, (uint64_t)(deltaOfDelta + 63), 7);
+    } else if (deltaOfDelta >= -255 && deltaOfDelta <= 256) {
+        ts_write_bits(data, bitLength, 0x6, 3);
+        ts_write_bits(data, bitLength, (uint64_t)(deltaOfDelta + 255), 9);
+    } else if (deltaOfDelta >= -2047 && deltaOfDelta <= 2048) {
+        ts_write_bits(data, bitLength, 0xE, 4);
+        ts_write_bits(data, bitLength, (uint64_t)(deltaOfDelta + 2047), 12);
+    } else {
+        ts_write_bits(data, bitLength, 0xF, 4);
+        ts_write_bits(data, bitLength, (uint32_t)(int32_t)deltaOfDelta, 32);
+    }
+    cursor->time = time;
+    cursor->delta = delta;
+
+    uint32_t xorValue = value ^ cursor->value;
+    if (xorValue == 0) {
+        ts_write_bits(data, bitLength, 0, 1);
+    } else {
+        int leading = __builtin_clz(xorValue);
+        int trailing = __builtin_ctz(xorValue);
+        if (cursor->leading >= 0 && leading >= cursor->leading && trailing >= cursor->trailing) {
+            // Fits in the previous window
+            ts_write_bits(data, bitLength, 0x2, 2);
+            ts_write_bits(data, bitLength, xorValue >> cursor->trailing, 32 - cursor->leading - cursor->trailing);
+        } else {
+            int meaningful = 32 - leading - trailing;
+            ts_write_bits(data, bitLength, 0x3, 2);
+            ts_write_bits(data, bitLength, leading, 5);
+            ts_write_bits(data, bitLength, meaningful - 1, 5);
+            ts_write_bits(data, bitLength, xorValue >> trailing, meaningful);
+            cursor->leading = leading;
+            cursor->trailing = trailing;
+        }
+    }
+    cursor->value = value;
+}
+
+// Read the next sample of a block, the cursor carries the decoder state between calls
+static void ts_decode(TsCursor* cursor, const uint8_t* data, uint32_t* position, uint32_t index, int64_t* time, uint32_t* value) {
+    if (index == 0) {
+        cursor->time = (int64_t)ts_read_bits(data, position, 64);
+        cursor->value = (uint32_t)ts_read_bits(data, position, 32);
+        cursor->delta = 0;
+        cursor->leading = -1;
+    } else {
+        int64_t deltaOfDelta;
+        if (ts_read_bits(data, position, 1) == 0) {
+            deltaOfDelta = 0;
+        } else if (ts_read_bits(data, position, 1) == 0) {
+            deltaOfDelta = (int64_t)ts_read_bits(data, position, 7) - 63;
+        } else if (ts_read_bits(data, position, 1) == 0) {
+            deltaOfDelta = (int64_t)ts_read_bits(data, position, 9) - 255;
+        } else if (ts_read_bits(data, position, 1) == 0) {
+            deltaOfDelta = (int64_t)ts_read_bits(data, position, 12) - 2047;
+        } else {
+            deltaOfDelta = (int32_t)(uint32_t)ts_read_bits(data, position, 32);
+        }
+        cursor->delta += deltaOfDelta;
+        cursor->time += cursor->delta;
+
+        if (ts_read_bits(data, position, 1) == 1) {
+            if (ts_read_bits(data, position, 1) == 1) {
+                cursor->leading = (int)ts_read_bits(data, position, 5);
+                int meaningful = (int)ts_read_bits(data, position, 5) + 1;
+                cursor->trailing = 32 - cursor->leading - meaningful;
+            }
+            int meaningful = 32 - cursor->leading - cursor->trailing;
+            cursor->value ^= (uint32_t)ts_read_bits(data, position, meaningful) << cursor->trailing;
+        }
+    }
+    *time = cursor->time;
+    *value = cursor->value;
+}
+
+// Take the next block around the ring, skipping blocks still open for another series
+static int ts_allocate_block(int series) {
+    for (int tries = 0; tries < TS_BLOCK_COUNT; tries++) {
+        int block = nextBlock;
+        nextBlock = nextBlock + 1 < TS_BLOCK_COUNT ? nextBlock + 1 : 1;
+        bool open = false;
+        for (int s = 0; s < TS_MAX_SERIES; s++) {
+            if (cursors[s].block == block) {
+                open = true;
+                break;
+            }
+        }
+        if (open) {
+            continue;
+        }
+        TsBlockHeader* header = ts_block(block);
+        if (header->magic != TS_BLOCK_MAGIC) {
+            tsBlocksUsed++;
+        }
+        memset(header, 0, sizeof(TsBlockHeader));
+        header->series = series;
+        header->sequence = nextSequence++;
+        header->magic = TS_BLOCK_MAGIC;
+        return block;
+    }
+    return 0;
+}
+
+static bool ts_block_valid(int block) {
+    const TsBlockHeader* header = ts_block(block);
+    return header->magic == TS_BLOCK_MAGIC && header->series < TS_MAX_SERIES && header->bitLength <= TS_DATA_BITS;
+}
+
+bool ts_open() {
+    char filepath[512];
+    getDataFilePath(TS_FILENAME, filepath, sizeof(filepath));
+    int fd = open(filepath, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logAndPublish("Error opening history file");
+        return false;
+    }
+    size_t fileSize = (size_t)TS_BLOCK_SIZE * TS_BLOCK_COUNT;
+    if (ftruncate(fd, fileSize) != 0) {
+        logAndPublish("Error sizing history file");
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        logAndPublish("Error mapping history file");
+        return false;
+    }
+    tsMap = (uint8_t*)map;
+
+    std::lock_guard<std::mutex> lock(tsMutex);
+    TsFileHeader* fileHeader = (TsFileHeader*)tsMap;
+    if (fileHeader->magic != TS_FILE_MAGIC || fileHeader->version != TS_VERSION || fileHeader->blockSize != TS_BLOCK_SIZE || fileHeader->blockCount != TS_BLOCK_COUNT) {
+        memset(tsMap, 0, fileSize);
+        fileHeader->magic = TS_FILE_MAGIC;
+        fileHeader->version = TS_VERSION;
+        fileHeader->blockSize = TS_BLOCK_SIZE;
+        fileHeader->blockCount = TS_BLOCK_COUNT;
+        logAndPublish("History file created");
+    }
+
+    // Resume after the newest block and reopen each series' newest block for appending
+    uint32_t newestSequence = 0;
+    uint32_t seriesSequence[TS_MAX_SERIES] = {0};
+    memset(cursors, 0, sizeof(cursors));
+    for (int block = 1; block < TS_BLOCK_COUNT; block++) {
+        if (!ts_block_valid(block)) {
+            continue;
+        }
+        const TsBlockHeader* header = ts_block(block);
+        tsBlocksUsed++;
+        if (header->sequence >= newestSequence) {
+            newestSequence = header->sequence;
+            nextBlock = block + 1 < TS_BLOCK_COUNT ? block + 1 : 1;
+        }
+        if (header->sequence >= seriesSequence[header->series]) {
+            seriesSequence[header->series] = header->sequence;
+            cursors[header->series].block = block;
+        }
+    }
+    nextSequence = newestSequence + 1;
+
+    for (int series = 0; series < TS_MAX_SERIES; series++) {
+        TsCursor* cursor = &cursors[series];
+        if (cursor->block == 0) {
+            continue;
+        }
+        const TsBlockHeader* header = ts_block(cursor->block);
+        uint32_t position = 0;
+        int64_t time;
+        uint32_t value;
+        for (uint32_t n = 0; n < header->count && position <= header->bitLength; n++) {
+            ts_decode(cursor, ts_block_data(cursor->block), &position, n, &time, &value);
+        }
+        if (position != header->bitLength) {
+            cursor->block = 0; // Inconsistent after a crash, start a fresh block
+        }
+    }
+    return true;
+}
+
+// Record one sample, samples not newer than the last one of the series are ignored
+void ts_append(int series, time_t time, float value) {
+    if (!tsMap || series < 0 || series >= TS_MAX_SERIES) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(tsMutex);
+    TsCursor* cursor = &cursors[series];
+    if (cursor->block != 0 && ts_block(cursor->block)->count > 0 && time <= cursor->time) {
+        return;
+    }
+    if (cursor->block == 0 || ts_block(cursor->block)->bitLength + TS_MAX_SAMPLE_BITS > TS_DATA_BITS ||
+        time - cursor->time > INT32_MAX) {
+        cursor->block = ts_allocate_block(series);
+        if (cursor->block == 0) {
+            return;
+        }
+    }
+
+    TsBlockHeader* header = ts_block(cursor->block);
+    uint32_t bitLength = header->bitLength;
+    ts_encode(cursor, ts_block_data(cursor->block), &bitLength, header->count, time, ts_float_bits(value));
+    if (header->count == 0) {
+        header->firstTime = time;
+    }
+    header->lastTime = time;
+    header->bitLength = bitLength;
+    header->count++;
+    tsSamples++;
+}
+
+typedef struct {
+    uint32_t sequence;
+    int block;
+} TsBlockOrder;
+
+static int ts_compare_sequence(const void* a, const void* b) {
+    uint32_t first = ((const TsBlockOrder*)a)->sequence;
+    uint32_t second = ((const TsBlockOrder*)b)->sequence;
+    return first < second ? -1 : first > second;
+}
+
+// Call visit for each sample of the series between from and to inclusive, oldest first.
+// Stops early if visit returns false. Returns the number of samples visited.
+int ts_scan(int series, time_t from, time_t to, bool (*visit)(time_t time, float value, void* context), void* context) {
+    if (!tsMap) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(tsMutex);
+
+    // Blocks of the series overlapping the range, in the order they were written
+    static TsBlockOrder matches[TS_BLOCK_COUNT];
+    int numberOfMatches = 0;
+    for (int block = 1; block < TS_BLOCK_COUNT; block++) {
+        if (!ts_block_valid(block)) {
+            continue;
+        }
+        const TsBlockHeader* header = ts_block(block);
+        if (header->series == series && header->count > 0 && header->lastTime >= from && header->firstTime <= to) {
+            matches[numberOfMatches].sequence = header->sequence;
+            matches[numberOfMatches].block = block;
+            numberOfMatches++;
+        }
+    }
+    qsort(matches, numberOfMatches, sizeof(TsBlockOrder), ts_compare_sequence);
+
+    int visited = 0;
+    for (int m = 0; m < numberOfMatches; m++) {
+        int block = matches[m].block;
+        const TsBlockHeader* header = ts_block(block);
+        TsCursor decoder;
+        uint32_t position = 0;
+        for (uint32_t n = 0; n < header->count && position <= header->bitLength; n++) {
+            int64_t time;
+            uint32_t value;
+            ts_decode(&decoder, ts_block_data(block), &position, n, &time, &value);
+            if (time > to) {
+                break;
+            }
+            if (time >= from) {
+                visited++;
+                if (!visit(time, ts_bits_float(value), context)) {
+                    return visited;
+                }
+            }
+        }
+    }
+    return visited;
+}
+
+// Push dirty pages out, the kernel writes them back on its own schedule otherwise
+void ts_sync() {
+    if (tsMap) {
+        msync(tsMap, (size_t)TS_BLOCK_SIZE * TS_BLOCK_COUNT, MS_SYNC);
+    }
+}
+
+void ts_report_stats() {
+    char stats_message[CHAR_LEN];
+    {
+        std::lock_guard<std::mutex> lock(tsMutex);
+        snprintf(stats_message, CHAR_LEN, "History %llu samples stored, %llu of %d blocks used", (unsigned long long)tsSamples, (unsigned long long)tsBlocksUsed,
+                 TS_BLOCK_COUNT - 1);
+        tsSamples = 0;
+    }
+    statsPublish(stats_message);
+}
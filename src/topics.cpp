@@ -0,0 +1,237 @@
+#include "globals.h"
+
+extern int numberOfReadings;
+extern std::mutex dataMutex;
+
+// Topic to reading slot index, open addressing with linear probing. Built once at startup so
+// routing an incoming message is one hash and normally one strcmp, whatever the sensor count.
+typedef struct {
+    uint32_t hash;
+    int slot; // -1 when empty
+} TopicIndexEntry;
+
+static TopicIndexEntry* topicIndex = NULL;
+static uint32_t topicIndexMask = 0;
+
+// FNV-1a, cheap and good enough for short MQTT topics
+uint32_t topic_hash(const char* topic) {
+    uint32_t hash = 2166136261u;
+    while (*topic) {
+        hash ^= (uint8_t)*topic++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Build the index over every reading slot, sized to stay under half full at MAX_READINGS
+bool topic_index_build() {
+    uint32_t capacity = 16;
+    uint32_t wanted = 2 * (numberOfReadings > MAX_READINGS ? numberOfReadings : MAX_READINGS);
+    while (capacity < wanted) {
+        capacity <<= 1;
+    }
+
+    TopicIndexEntry* entries = (TopicIndexEntry*)malloc(capacity * sizeof(TopicIndexEntry));
+    if (!entries) {
+        logAndPublish("Failed to allocate topic index");
+        return false;
+    }
+    for (uint32_t i = 0; i < capacity; i++) {
+        entries[i].slot = -1;
+    }
+    free(topicIndex);
+    topicIndex = entries;
+    topicIndexMask = capacity - 1;
+
+    for (int i = 0; i < numberOfReadings; i++) {
+        topic_index_add(i);
+    }
+    return true;
+}
+
+// Add one reading slot under its topic, a topic already present keeps its first slot
+bool topic_index_add(int slot) {
+    const char* topic = reading_topic(slot);
+    uint32_t hash = topic_hash(topic);
+    for (uint32_t probe = hash & topicIndexMask;; probe = (probe + 1) & topicIndexMask) {
+        TopicIndexEntry* entry = &topicIndex[probe];
+        if (entry->slot < 0) {
+            entry->hash = hash;
+            entry->slot = slot;
+            return true;
+        }
+        if (entry->hash == hash && strcmp(reading_topic(entry->slot), topic) == 0) {
+            char log_message[CHAR_LEN];
+            snprintf(log_message, CHAR_LEN, "Duplicate sensor topic %.200s ignored", topic);
+            errorPublish(log_message);
+            return false;
+        }
+    }
+}
+
+// Reading slot for a topic, or -1 if no sensor is subscribed to it
+int topic_index_find(const char* topic) {
+    if (!topicIndex) {
+        return -1;
+    }
+    uint32_t hash = topic_hash(topic);
+    for (uint32_t probe = hash & topicIndexMask;; probe = (probe + 1) & topicIndexMask) {
+        const TopicIndexEntry* entry = &topicIndex[probe];
+        if (entry->slot < 0) {
+            return -1;
+        }
+        if (entry->hash == hash && strcmp(reading_topic(entry->slot), topic) == 0) {
+            return entry->slot;
+        }
+    }
+}
+
+// Trie over the segments of TOPIC_PATTERNS. Each node is one filter segment, a literal or a
+// + / # wildcard, and records the pattern whose filter ends there.
+#define TOPIC_TRIE_MAX_NODES 64
+#define TOPIC_SEGMENT_LEN 64
+
+typedef struct {
+    char segment[TOPIC_SEGMENT_LEN];
+    int firstChild;  // -1 when none
+    int nextSibling; // -1 when none
+    int pattern;     // Index into topicPatterns, -1 if no filter ends here
+} TopicTrieNode;
+
+static const TopicPattern topicPatterns[] = {TOPIC_PATTERNS};
+static const int topicPatternCount = sizeof(topicPatterns) / sizeof(topicPatterns[0]);
+static_assert(sizeof(topicPatterns) / sizeof(topicPatterns[0]) <= MAX_TOPIC_PATTERNS, "Raise MAX_TOPIC_PATTERNS");
+static TopicTrieNode topicTrie[TOPIC_TRIE_MAX_NODES];
+static int topicTrieNodes = 0;
+
+static int topic_trie_new_node(const char* segment, size_t length) {
+    if (topicTrieNodes >= TOPIC_TRIE_MAX_NODES || length >= TOPIC_SEGMENT_LEN) {
+        return -1;
+    }
+    TopicTrieNode* node = &topicTrie[topicTrieNodes];
+    memcpy(node->segment, segment, length);
+    node->segment[length] = '\0';
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    node->pattern = -1;
+    return topicTrieNodes++;
+}
+
+// Find the child of parent for a segment, creating it if asked
+static int topic_trie_child(int parent, const char* segment, size_t length, bool create) {
+    int child = topicTrie[parent].firstChild;
+    while (child >= 0) {
+        if (strlen(topicTrie[child].segment) == length && strncmp(topicTrie[child].segment, segment, length) == 0) {
+            return child;
+        }
+        child = topicTrie[child].nextSibling;
+    }
+    if (!create) {
+        return -1;
+    }
+    child = topic_trie_new_node(segment, length);
+    if (child >= 0) {
+        topicTrie[child].nextSibling = topicTrie[parent].firstChild;
+        topicTrie[parent].firstChild = child;
+    }
+    return child;
+}
+
+void topic_trie_build() {
+    topicTrieNodes = 0;
+    topic_trie_new_node("", 0); // Root
+
+    for (int i = 0; i < topicPatternCount; i++) {
+        int node = 0;
+        const char* segment = topicPatterns[i].filter;
+        while (node >= 0) {
+            const char* end = strchr(segment, '/');
+            size_t length = end ? (size_t)(end - segment) : strlen(segment);
+            node = topic_trie_child(node, segment, length, true);
+            if (!end) {
+                break;
+            }
+            segment = end + 1;
+        }
+        if (node < 0) {
+            char log_message[CHAR_LEN];
+            snprintf(log_message, CHAR_LEN, "Topic pattern %.200s does not fit the trie", topicPatterns[i].filter);
+            errorPublish(log_message);
+            continue;
+        }
+        topicTrie[node].pattern = i;
+    }
+}
+
+// Match the rest of a topic below a node, literal segments win over + and + over #.
+// The segment matched by the first + is captured as the room.
+static int topic_trie_match(int node, const char* topic, char* room, size_t roomSize) {
+    if (*topic == '\0') {
+        return topicTrie[node].pattern;
+    }
+    const char* end = strchr(topic, '/');
+    size_t length = end ? (size_t)(end - topic) : strlen(topic);
+    const char* rest = end ? end + 1 : topic + length;
+
+    int child = topic_trie_child(node, topic, length, false);
+    if (child >= 0) {
+        int pattern = topic_trie_match(child, rest, room, roomSize);
+        if (pattern >= 0) {
+            return pattern;
+        }
+    }
+
+    child = topic_trie_child(node, "+", 1, false);
+    if (child >= 0) {
+        bool capture = (room[0] == '\0');
+        if (capture) {
+            snprintf(room, roomSize, "%.*s", (int)length, topic);
+        }
+        int pattern = topic_trie_match(child, rest, room, roomSize);
+        if (pattern >= 0) {
+            return pattern;
+        }
+        if (capture) {
+            room[0] = '\0';
+        }
+    }
+
+    child = topic_trie_child(node, "#", 1, false);
+    if (child >= 0) {
+        return topicTrie[child].pattern;
+    }
+    return -1;
+}
+
+// Match a topic against TOPIC_PATTERNS, giving the data type and room segment of the first match
+int topic_pattern_match(const char* topic, int* dataType, char* room, size_t roomSize) {
+    if (topicTrieNodes == 0 || roomSize == 0) {
+        return -1;
+    }
+    room[0] = '\0';
+    int pattern = topic_trie_match(0, topic, room, roomSize);
+    if (pattern >= 0) {
+        *dataType = topicPatterns[pattern].dataType;
+    }
+    return pattern;
+}
+
+// Topic filters to subscribe to, the patterns plus any known sensor topic they don't cover.
+// Called from the mosquitto thread while the ingest worker may be adding slots, so the table is
+// read under dataMutex. Slots are never removed or rewritten, the topics stay valid after it.
+int topic_subscriptions(const char** filters, int maxFilters) {
+    int count = 0;
+    for (int i = 0; i < topicPatternCount && count < maxFilters; i++) {
+        filters[count++] = topicPatterns[i].filter;
+    }
+
+    char room[CHAR_LEN];
+    int dataType;
+    std::lock_guard<std::mutex> lock(dataMutex);
+    for (int i = 0; i < numberOfReadings && count < maxFilters; i++) {
+        if (topic_pattern_match(reading_topic(i), &dataType, room, sizeof(room)) < 0) {
+            filters[count++] = reading_topic(i);
+        }
+    }
+    return count;
+}
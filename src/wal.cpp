@@ -0,0 +1,259 @@
+#include "globals.h"
+#include <cerrno>
+#include <fcntl.h>
+
+extern ReadingsTable readings;
+extern int numberOfReadings;
+
+// Write-ahead log of sensor updates. Every applied MQTT value is appended as one small record,
+// the readings snapshot in the state store is only rewritten when the log is compacted. Records
+// carry a sequence number, the snapshot stores the last one it includes in readings.walSequence,
+// so startup replays just the records after it. Appends are not synced one by one, the persistence
+// thread syncs them together WAL_SYNC_INTERVAL_SEC after the first, so a power cut loses at most
+// that long of readings. A crash of the program alone loses nothing, the records are in the page cache.
+static int walFd = -1;
+static std::mutex walMutex;
+static uint64_t walNextSequence = 1;
+static uint32_t walRecordsSinceSnapshot = 0;
+static time_t walSnapshotRequested = 0;
+static time_t walLastCompaction = 0;
+static std::atomic<time_t> walUnsyncedSince(0); // First append not yet synced, 0 if none. Read without walMutex
+
+// Log counters, reported by wal_report_stats()
+static uint64_t walAppended = 0;
+static uint64_t walBytes = 0;
+static uint64_t walCompactions = 0;
+static uint64_t walSyncs = 0;
+
+static void wal_path(char* path, size_t size) {
+    getDataFilePath(WAL_FILENAME, path, size);
+}
+
+static uint32_t wal_record_checksum(const WalRecord* record) {
+    return crc32c(record, offsetof(WalRecord, checksum));
+}
+
+// Replay records newer than the restored snapshot, then open the log for appending. A torn or
+// corrupt record ends the replay, everything after it is discarded.
+void wal_init() {
+    char path[512];
+    wal_path(path, sizeof(path));
+
+    uint64_t snapshotSequence = readings.walSequence;
+    uint64_t lastSequence = snapshotSequence;
+    int replayed = 0;
+    off_t validLength = 0;
+
+    FILE* walFile = fopen(path, "rb");
+    if (walFile) {
+        WalRecord batch[WAL_REPLAY_BATCH];
+        size_t got;
+        bool valid = true;
+        while (valid && (got = fread(batch, sizeof(WalRecord), WAL_REPLAY_BATCH, walFile)) > 0) {
+            DataWriteGuard publish;
+            for (size_t n = 0; n < got; n++) {
+                const WalRecord* record = &batch[n];
+                if (record->checksum != wal_record_checksum(record)) {
+                    valid = false;
+                    break;
+                }
+                validLength += sizeof(WalRecord);
+                if (record->sequence <= snapshotSequence) {
+                    continue;
+                }
+                if (record->slot < numberOfReadings) {
+                    update_readings(record->value, record->slot, reading_data_type(record->slot), record->time);
+                    replayed++;
+                }
+                lastSequence = record->sequence;
+                readings.walSequence = lastSequence;
+            }
+        }
+        fclose(walFile);
+    }
+
+    walNextSequence = lastSequence + 1;
+    walFd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (walFd < 0) {
+        logAndPublish("Error opening readings log, saving snapshots instead");
+        return;
+    }
+    // Drop a torn tail so new records follow the last good one
+    if (ftruncate(walFd, validLength) != 0) {
+        logAndPublish("Failed to trim readings log");
+    }
+    walRecordsSinceSnapshot = validLength / sizeof(WalRecord);
+    walLastCompaction = time(NULL);
+
+    if (replayed > 0) {
+        char log_message[CHAR_LEN];
+        snprintf(log_message, CHAR_LEN, "Replayed %d readings from log", replayed);
+        logAndPublish(log_message);
+    }
+}
+
+// Number the records and append them with one write. Called by the ingest worker, which also
+// applies them under the same DataWriteGuard so readings.walSequence always matches the table.
+bool wal_append(WalRecord* records, int count) {
+    std::lock_guard<std::mutex> lock(walMutex);
+    if (walFd < 0) {
+        return false;
+    }
+    off_t start = lseek(walFd, 0, SEEK_END);
+    if (start < 0) {
+        logAndPublish("Failed to append to readings log");
+        return false;
+    }
+    for (int n = 0; n < count; n++) {
+        records[n].sequence = walNextSequence + n;
+        records[n].checksum = wal_record_checksum(&records[n]);
+    }
+
+    // A failed append is cut back off, so a torn record never sits in front of later ones
+    const uint8_t* bytes = (const uint8_t*)records;
+    size_t size = count * sizeof(WalRecord);
+    bool appended = true;
+    while (size > 0) {
+        ssize_t written = write(walFd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            appended = false;
+            break;
+        }
+        bytes += written;
+        size -= written;
+    }
+    if (!appended) {
+        logAndPublish("Failed to append to readings log");
+        if (ftruncate(walFd, start) != 0) {
+            logAndPublish("Failed to trim readings log, saving snapshots instead");
+            close(walFd);
+            walFd = -1;
+        }
+        return false;
+    }
+    walNextSequence += count;
+    if (walUnsyncedSince.load(std::memory_order_relaxed) == 0) {
+        walUnsyncedSince.store(time(NULL), std::memory_order_relaxed);
+        persistence_wake();
+    }
+
+    walAppended += count;
+    walBytes += count * sizeof(WalRecord);
+    walRecordsSinceSnapshot += count;
+
+    // Ask for a snapshot once the log is long or old enough, the persistence thread writes it
+    time_t now = time(NULL);
+    if (walSnapshotRequested == 0 && (walRecordsSinceSnapshot >= WAL_COMPACT_RECORDS || now - walLastCompaction >= WAL_COMPACT_INTERVAL_SEC)) {
+        walSnapshotRequested = now;
+        markDataDirty(STATE_SECTION_READINGS);
+    }
+    return true;
+}
+
+// When the persistence thread should call wal_sync(), 0 if nothing is waiting
+time_t wal_sync_due() {
+    time_t since = walUnsyncedSince.load(std::memory_order_relaxed);
+    return since ? since + WAL_SYNC_INTERVAL_SEC : 0;
+}
+
+// Sync the appends made since the last sync once they are due, or straight away with force.
+// If the sync fails the readings snapshot is written instead, so the values are not lost.
+void wal_sync(bool force) {
+    std::lock_guard<std::mutex> lock(walMutex);
+    time_t since = walUnsyncedSince.load(std::memory_order_relaxed);
+    if (walFd < 0 || since == 0 || (!force && time(NULL) < since + WAL_SYNC_INTERVAL_SEC)) {
+        return;
+    }
+    walUnsyncedSince.store(0, std::memory_order_relaxed);
+    if (fdatasync(walFd) != 0) {
+        logAndPublish("Failed to sync readings log");
+        markDataDirty(STATE_SECTION_READINGS);
+        return;
+    }
+    walSyncs++;
+}
+
+// Called once a readings snapshot is safely on disk, drops the records it includes. Records
+// appended while the snapshot was written are kept by rewriting them into a fresh log.
+void wal_snapshot_written(uint64_t sequence) {
+    std::lock_guard<std::mutex> lock(walMutex);
+    if (walFd < 0) {
+        return;
+    }
+    walSnapshotRequested = 0;
+    walLastCompaction = time(NULL);
+
+    if (sequence + 1 >= walNextSequence) {
+        if (ftruncate(walFd, 0) != 0) {
+            logAndPublish("Failed to compact readings log");
+            return;
+        }
+        walRecordsSinceSnapshot = 0;
+        walUnsyncedSince.store(0, std::memory_order_relaxed);
+        walCompactions++;
+        return;
+    }
+
+    char path[512];
+    char temppath[520];
+    wal_path(path, sizeof(path));
+    snprintf(temppath, sizeof(temppath), "%s.tmp", path);
+    FILE* walFile = fopen(path, "rb");
+    FILE* tempFile = fopen(temppath, "wb");
+    if (!walFile || !tempFile) {
+        if (walFile) {
+            fclose(walFile);
+        }
+        if (tempFile) {
+            fclose(tempFile);
+        }
+        logAndPublish("Failed to compact readings log");
+        return;
+    }
+    WalRecord record;
+    uint32_t kept = 0;
+    while (fread(&record, sizeof(record), 1, walFile) == 1) {
+        if (record.sequence > sequence) {
+            fwrite(&record, sizeof(record), 1, tempFile);
+            kept++;
+        }
+    }
+    fclose(walFile);
+    fflush(tempFile);
+    fsync(fileno(tempFile));
+    fclose(tempFile);
+
+    int fd = open(temppath, O_WRONLY | O_APPEND);
+    if (fd < 0 || rename(temppath, path) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(temppath);
+        logAndPublish("Failed to compact readings log");
+        return;
+    }
+    syncDataDirectory();
+    close(walFd);
+    walFd = fd;
+    walRecordsSinceSnapshot = kept;
+    walUnsyncedSince.store(0, std::memory_order_relaxed); // Every kept record was synced into the new log
+    walCompactions++;
+}
+
+void wal_report_stats() {
+    char stats_message[CHAR_LEN];
+    {
+        std::lock_guard<std::mutex> lock(walMutex);
+        snprintf(stats_message, CHAR_LEN, "Readings log %llu records, %llu bytes appended, %llu syncs, %llu compactions, %u records pending",
+                 (unsigned long long)walAppended, (unsigned long long)walBytes, (unsigned long long)walSyncs, (unsigned long long)walCompactions,
+                 walRecordsSinceSnapshot);
+        walAppended = 0;
+        walBytes = 0;
+        walCompactions = 0;
+        walSyncs = 0;
+    }
+    statsPublish(stats_message);
+}